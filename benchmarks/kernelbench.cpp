@@ -0,0 +1,264 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file kernelbench.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Microbenchmarks for the aggregation and input translation kernels over synthetic registries.
+ *
+ * Usage: kernelbench [--atoms=N] [--arity=A] [--others=O] [--models=M] [--density=D] [--core=C]
+ *                    [--inputs=K] [--changes=F] [--iterations=I] [--threads=T] [--seed=S]
+ *
+ * Creates N atoms of arity A over the query predicate (and O times as many atoms over another predicate,
+ * such that the density of the mask can be varied) and M answer sets, each of which contains a fraction C of the query atoms in any case and every
+ * other atom with probability D. The input translation is measured over a sequence of inputs of
+ * K higher-order atoms, where successive inputs differ in a fraction F of the atoms.
+ * With T > 1, the aggregation kernels are additionally measured on T threads.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "Kernels.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Registry.h"
+#include "dlvhex2/Interpretation.h"
+#include "dlvhex2/PredicateMask.h"
+
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+using namespace dlvhex;
+using namespace dlvhex::nestedhex;
+
+namespace{
+
+// milliseconds since start
+double elapsed(const boost::posix_time::ptime& start){
+	return (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1000.0;
+}
+
+bool randomBit(double probability){
+	return std::rand() < probability * RAND_MAX;
+}
+
+ID storePredicate(RegistryPtr reg, const std::string& name){
+	Term term(ID::MAINKIND_TERM | ID::SUBKIND_TERM_PREDICATE, name);
+	return reg->storeTerm(term);
+}
+
+ID storeAtom(RegistryPtr reg, const Tuple& tuple){
+	OrdinaryAtom oatom(ID::MAINKIND_ATOM | ID::SUBKIND_ATOM_ORDINARYG);
+	oatom.tuple = tuple;
+	return reg->storeOrdinaryAtom(oatom);
+}
+
+void report(const std::string& kernel, double ms, int iterations, std::size_t resultSize){
+	std::cout << std::left << std::setw(24) << kernel << std::right
+		<< std::setw(12) << std::fixed << std::setprecision(3) << ms << " ms"
+		<< std::setw(14) << std::setprecision(6) << (ms / iterations) << " ms/iteration"
+		<< std::setw(10) << resultSize << " result size" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv){
+
+	std::map<std::string, std::string> options;
+	options["atoms"] = "10000";
+	options["arity"] = "2";
+	options["others"] = "1";
+	options["models"] = "1000";
+	options["density"] = "0.5";
+	options["core"] = "0.1";
+	options["inputs"] = "10000";
+	options["changes"] = "0.01";
+	options["iterations"] = "100";
+	options["threads"] = "1";
+	options["seed"] = "42";
+	for (int i = 1; i < argc; ++i){
+		std::string arg = argv[i];
+		std::size_t eq = arg.find('=');
+		if (arg.substr(0, 2) != "--" || eq == std::string::npos || options.count(arg.substr(2, eq - 2)) == 0){
+			std::cerr << "invalid argument: " << arg << std::endl;
+			return 1;
+		}
+		options[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+	}
+
+	int atoms, arity, others, models, inputs, iterations, threads;
+	double density, core, changes;
+	try{
+		atoms = boost::lexical_cast<int>(options["atoms"]);
+		arity = boost::lexical_cast<int>(options["arity"]);
+		others = boost::lexical_cast<int>(options["others"]);
+		models = boost::lexical_cast<int>(options["models"]);
+		inputs = boost::lexical_cast<int>(options["inputs"]);
+		iterations = boost::lexical_cast<int>(options["iterations"]);
+		threads = boost::lexical_cast<int>(options["threads"]);
+		density = boost::lexical_cast<double>(options["density"]);
+		core = boost::lexical_cast<double>(options["core"]);
+		changes = boost::lexical_cast<double>(options["changes"]);
+		std::srand(boost::lexical_cast<unsigned>(options["seed"]));
+	}catch(const boost::bad_lexical_cast&){
+		std::cerr << "invalid option value" << std::endl;
+		return 1;
+	}
+	if (atoms < 1 || arity < 1 || others < 0 || models < 0 || inputs < 1 || iterations < 1 || threads < 1){
+		std::cerr << "invalid option value" << std::endl;
+		return 1;
+	}
+
+	RegistryPtr reg(new Registry());
+	ID q = storePredicate(reg, "q");
+	ID r = storePredicate(reg, "r");
+
+	// query atoms q(i, 0, ..., 0) and other atoms r(j) in alternating order (such that the mask is scattered)
+	std::vector<IDAddress> queryAtoms, otherAtoms;
+	for (int i = 0; i < atoms; ++i){
+		Tuple t;
+		t.push_back(q);
+		t.push_back(ID::termFromInteger(i));
+		for (int a = 1; a < arity; ++a) t.push_back(ID::termFromInteger(0));
+		queryAtoms.push_back(storeAtom(reg, t).address);
+
+		for (int o = 0; o < others; ++o){
+			t.clear();
+			t.push_back(r);
+			t.push_back(ID::termFromInteger(i * others + o));
+			otherAtoms.push_back(storeAtom(reg, t).address);
+		}
+	}
+
+	std::vector<InterpretationPtr> answersets;
+	for (int m = 0; m < models; ++m){
+		InterpretationPtr intr(new Interpretation(reg));
+		for (int i = 0; i < atoms; ++i){
+			if (i < core * atoms || randomBit(density)) intr->setFact(queryAtoms[i]);
+		}
+		BOOST_FOREACH (IDAddress adr, otherAtoms){
+			if (randomBit(density)) intr->setFact(adr);
+		}
+		answersets.push_back(intr);
+	}
+
+	PredicateMask pm;
+	pm.setRegistry(reg);
+	pm.addPredicate(q);
+	pm.updateMask();
+
+	std::cout << atoms << " query atoms of arity " << arity << ", " << otherAtoms.size() << " other atoms, " << models << " answer sets" << std::endl;
+
+	// aggregation kernels
+	bm::bvector<> result;
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+	for (int it = 0; it < iterations; ++it) intersectAnswerSets(pm.mask()->getStorage(), answersets, result);
+	report("intersectAnswerSets", elapsed(start), iterations, result.count());
+	bm::bvector<> cautious = result;
+
+	start = boost::posix_time::microsec_clock::universal_time();
+	for (int it = 0; it < iterations; ++it) uniteAnswerSets(pm.mask()->getStorage(), answersets, result);
+	report("uniteAnswerSets", elapsed(start), iterations, result.count());
+	bm::bvector<> brave = result;
+
+	if (threads > 1){
+		start = boost::posix_time::microsec_clock::universal_time();
+		for (int it = 0; it < iterations; ++it) intersectAnswerSets(pm.mask()->getStorage(), answersets, result, threads);
+		report("intersectAnswerSets (" + options["threads"] + ")", elapsed(start), iterations, result.count());
+		if (result != cautious) std::cerr << "parallel intersection differs from the sequential one" << std::endl;
+
+		start = boost::posix_time::microsec_clock::universal_time();
+		for (int it = 0; it < iterations; ++it) uniteAnswerSets(pm.mask()->getStorage(), answersets, result, threads);
+		report("uniteAnswerSets (" + options["threads"] + ")", elapsed(start), iterations, result.count());
+		if (result != brave) std::cerr << "parallel union differs from the sequential one" << std::endl;
+	}
+
+	// tuple extraction (for the brave consequences, which is the larger set)
+	std::size_t tuples = 0;
+	start = boost::posix_time::microsec_clock::universal_time();
+	for (int it = 0; it < iterations; ++it){
+		std::vector<Tuple> output;
+		extractTuples(*reg, brave, output);
+		tuples = output.size();
+	}
+	report("extractTuples", elapsed(start), iterations, tuples);
+
+	// input translation: higher-order atoms inp(q, arity, i, 0, ..., 0)
+	ID inp = storePredicate(reg, "inp");
+	ID emptyID = reg->storeConstantTerm("empty");
+	std::vector<IDAddress> inputAtoms;
+	for (int i = 0; i < inputs; ++i){
+		Tuple t;
+		t.push_back(inp);
+		t.push_back(q);
+		t.push_back(ID::termFromInteger(arity));
+		t.push_back(ID::termFromInteger(i));
+		for (int a = 1; a < arity; ++a) t.push_back(ID::termFromInteger(0));
+		inputAtoms.push_back(storeAtom(reg, t).address);
+	}
+
+	// a sequence of inputs, each differing from its predecessor in the given fraction of atoms
+	std::vector<InterpretationPtr> inputSequence;
+	InterpretationPtr current(new Interpretation(reg));
+	for (int i = 0; i < inputs; ++i) if (randomBit(0.5)) current->setFact(inputAtoms[i]);
+	for (int it = 0; it < iterations; ++it){
+		InterpretationPtr next(new Interpretation(reg));
+		next->add(*current);
+		for (int c = 0; c < changes * inputs; ++c){
+			IDAddress adr = inputAtoms[std::rand() % inputs];
+			if (next->getFact(adr)) next->clearFact(adr);
+			else next->setFact(adr);
+		}
+		inputSequence.push_back(next);
+		current = next;
+	}
+
+	std::size_t translated = 0;
+	{
+		// the first call fills the translation table
+		InputTranslator translator;
+		InputFingerprint fingerprint;
+		start = boost::posix_time::microsec_clock::universal_time();
+		translated = translator.translate(reg, emptyID, inputSequence[0], fingerprint)->getStorage().count();
+		report("translate (cold)", elapsed(start), 1, translated);
+
+		start = boost::posix_time::microsec_clock::universal_time();
+		BOOST_FOREACH (InterpretationPtr input, inputSequence){
+			translated = translator.translate(reg, emptyID, input, fingerprint)->getStorage().count();
+		}
+		report("translate (incremental)", elapsed(start), iterations, translated);
+	}
+
+	return (cautious.count() <= brave.count() ? 0 : 1);
+}
@@ -0,0 +1,214 @@
+#!/usr/bin/env python
+#
+# Scaling benchmarks for the nested HEX plugin.
+#
+# Generates parameterized workloads, runs dlvhex on each of them and records
+# wall time, peak resident set size and the counters reported by the plugin
+# (--nestedhex-stats). The results are written as tab-separated table.
+#
+# Usage: run-benchmarks.py [options]
+#   --dlvhex=<cmd>        dlvhex command (default: $DLVHEX or "dlvhex2")
+#   --examples=<dir>      directory with the example programs (default: $EXAMPLESDIR or ../examples)
+#   --workdir=<dir>       directory for the generated workloads (default: temporary directory)
+#   --output=<file>       result table (default: stdout)
+#   --families=<f1,...>   workload families to run (default: all)
+#   --scale=<n>           multiplies all sizes (default: 1)
+#   --repeat=<n>          runs per instance, the run with the median time is reported (default: 1)
+#   --timeout=<s>         timeout per run in seconds (default: 300)
+#   --options=<opts>      further options passed to dlvhex (e.g. "--nestedhex-iterative")
+
+from __future__ import print_function
+
+import os
+import re
+import sys
+import time
+import errno
+import shlex
+import signal
+import random
+import tempfile
+
+# ============================== Workload families ==============================
+#
+# Each family yields (name, size, files, options), where files maps filenames to
+# their content and the first file is the outer program.
+
+def distinctInputs(scale):
+	# guessing over n atoms yields 2^n distinct inputs to the same subprogram
+	for n in [4, 6, 8, 10, 12]:
+		n = n * scale
+		outer = "".join("dom(%d).\n" % i for i in range(n))
+		outer += "sel(X) v nsel(X) :- dom(X).\n"
+		outer += "inp(p, 1, X) :- sel(X).\n"
+		outer += "res(X) :- &hexCautious[string, \"q(X) :- p(X), not r(X). r(0).\", inp, q](X).\n"
+		yield ("distinct-inputs", n, {"main.hex": outer}, [])
+
+def deepNesting(scale):
+	# a chain of subprograms, each one forwarding its input to the next one
+	for depth in [1, 2, 4, 8]:
+		depth = depth * scale
+		files = {}
+		files["level0.hex"] = "q(X) :- p(X).\n"
+		for level in range(1, depth + 1):
+			files["level%d.hex" % level] = "inp(p, 1, X) :- p(X).\nq(X) :- &hexBrave[file, \"level%d.hex\", inp, q](X).\n" % (level - 1)
+		outer = "".join("dom(%d).\n" % i for i in range(4))
+		outer += "sel(X) v nsel(X) :- dom(X).\n"
+		outer += "inp(p, 1, X) :- sel(X).\n"
+		outer += "res(X) :- &hexBrave[file, \"level%d.hex\", inp, q](X).\n" % depth
+		yield ("deep-nesting", depth, dict([("main.hex", outer)] + list(files.items())), [])
+
+def manyModels(scale):
+	# the subprogram has 2^n answer sets
+	for n in [4, 8, 12, 14]:
+		n = n * scale
+		outer = "".join("inp(p, 1, %d).\n" % i for i in range(n))
+		outer += "count(I, N) :- &hexInspection[string, \"a(X) v b(X) :- p(X).\", inp, program](I, N).\n"
+		outer += "cautious(X) :- &hexCautious[string, \"a(X) v b(X) :- p(X).\", inp, a](X).\n"
+		outer += "brave(X) :- &hexBrave[string, \"a(X) v b(X) :- p(X).\", inp, a](X).\n"
+		yield ("many-models", n, {"main.hex": outer}, [])
+
+def wideInputs(scale):
+	# input atoms of growing arity
+	for arity in [2, 8, 16, 32]:
+		arity = arity * scale
+		outer = ""
+		for i in range(50):
+			outer += "inp(f, %d, %s).\n" % (arity, ", ".join("c%d_%d" % (i, j) for j in range(arity)))
+		variables = ", ".join("X%d" % j for j in range(arity))
+		outer += "res(X0) :- &hexCautious[string, \"q(X0) :- f(%s).\", inp, q](X0).\n" % variables
+		yield ("wide-inputs", arity, {"main.hex": outer}, [])
+
+def coloring(scale, examples):
+	# the graph coloring subprogram of examples/3col.hex over random graphs of growing size;
+	# a graph with n nodes has up to 3^n colorings, thus the consequences are computed iteratively instead of enumerating them
+	with open(os.path.join(examples, "3col.hex")) as f:
+		rules = "".join(line for line in f if not line.strip().startswith("edge("))
+	rnd = random.Random(42)
+	for nodes in [5, 10, 20, 40]:
+		nodes = nodes * scale
+		outer = ""
+		for i in range(nodes):
+			for j in range(i + 1, nodes):
+				if rnd.random() < 2.0 / nodes:
+					outer += "inp(edge, 2, %d, %d).\n" % (i, j)
+		outer += "col(N, C) :- &hexBrave[file, \"3col.hex\", inp, colored](N, C).\n"
+		outer += "fixed(N, C) :- &hexCautious[file, \"3col.hex\", inp, colored](N, C).\n"
+		yield ("3col", nodes, {"main.hex": outer, "3col.hex": rules}, ["--nestedhex-iterative"])
+
+FAMILIES = ["distinct-inputs", "deep-nesting", "many-models", "wide-inputs", "3col"]
+
+def workloads(families, scale, examples):
+	generators = {
+		"distinct-inputs": lambda: distinctInputs(scale),
+		"deep-nesting": lambda: deepNesting(scale),
+		"many-models": lambda: manyModels(scale),
+		"wide-inputs": lambda: wideInputs(scale),
+		"3col": lambda: coloring(scale, examples),
+	}
+	for family in families:
+		if family not in generators:
+			raise SystemExit("unknown workload family: " + family)
+		for w in generators[family]():
+			yield w
+
+# ============================== Measurement ==============================
+
+def run(command, cwd, timeout):
+	# returns (exit status, wall time in seconds, peak RSS in KB) of a single run
+	start = time.time()
+	with open(os.devnull, "w") as devnull:
+		pid = os.fork()
+		if pid == 0:
+			os.chdir(cwd)
+			os.dup2(devnull.fileno(), 1)
+			os.setpgid(0, 0)
+			try:
+				os.execvp(command[0], command)
+			finally:
+				os._exit(127)
+	deadline = start + timeout
+	while True:
+		try:
+			wpid, status, usage = os.wait4(pid, os.WNOHANG)
+		except OSError as e:
+			if e.errno == errno.EINTR:
+				continue
+			raise
+		if wpid == pid:
+			break
+		if time.time() > deadline:
+			os.killpg(pid, signal.SIGKILL)
+			wpid, status, usage = os.wait4(pid, 0)
+			return ("timeout", timeout, usage.ru_maxrss)
+		time.sleep(0.01)
+	wall = time.time() - start
+	# ru_maxrss is in KB on Linux and in bytes on Mac OS
+	rss = usage.ru_maxrss if sys.platform != "darwin" else usage.ru_maxrss // 1024
+	return (os.WEXITSTATUS(status) if os.WIFEXITED(status) else "signal", wall, rss)
+
+def readStats(filename):
+	# sums up the counters of all subprograms in the statistics file of the plugin
+	totals = {"calls": 0, "hits": 0, "misses": 0, "solvercalls": 0, "answersets": 0}
+	try:
+		with open(filename) as f:
+			header = f.readline().rstrip("\n").split("\t")
+			for line in f:
+				values = dict(zip(header, line.rstrip("\n").split("\t")))
+				for key in totals:
+					totals[key] += int(values.get(key, 0))
+	except IOError:
+		return None
+	return totals
+
+def main():
+	options = {
+		"dlvhex": os.environ.get("DLVHEX", "dlvhex2"),
+		"examples": os.environ.get("EXAMPLESDIR", os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "examples")),
+		"workdir": None,
+		"output": None,
+		"families": ",".join(FAMILIES),
+		"scale": "1",
+		"repeat": "1",
+		"timeout": "300",
+		"options": "",
+	}
+	for arg in sys.argv[1:]:
+		m = re.match(r"--([a-z]+)=(.*)$", arg)
+		if not m or m.group(1) not in options:
+			raise SystemExit("invalid argument: " + arg + "\n(see the header of this script for the usage)")
+		options[m.group(1)] = m.group(2)
+
+	workdir = options["workdir"] or tempfile.mkdtemp(prefix="nestedhex-bench-")
+	scale = int(options["scale"])
+	repeat = int(options["repeat"])
+	timeout = float(options["timeout"])
+	out = open(options["output"], "w") if options["output"] else sys.stdout
+
+	print("family\tsize\tstatus\twalltime\tpeakrss_kb\tcalls\thits\tmisses\tsolvercalls\tanswersets", file=out)
+	for (family, size, files, extra) in workloads(options["families"].split(","), scale, options["examples"]):
+		instancedir = os.path.join(workdir, "%s-%d" % (family, size))
+		if not os.path.isdir(instancedir):
+			os.makedirs(instancedir)
+		for (name, content) in files.items():
+			with open(os.path.join(instancedir, name), "w") as f:
+				f.write(content)
+
+		statsfile = os.path.join(instancedir, "stats.tsv")
+		command = shlex.split(options["dlvhex"]) + shlex.split(options["options"]) + extra + ["--nestedhex-stats=" + statsfile, "main.hex"]
+		# each result holds status, wall time, peak RSS and statistics of one run, such that all fields reported come from the median run
+		results = []
+		for r in range(repeat):
+			# a run which fails before writing the statistics must not report the ones of a previous run
+			if os.path.exists(statsfile):
+				os.remove(statsfile)
+			status, wall, rss = run(command, instancedir, timeout)
+			results.append((status, wall, rss, readStats(statsfile) or {}))
+		results.sort(key=lambda result: result[1])
+		status, wall, rss, stats = results[len(results) // 2]
+		print("%s\t%d\t%s\t%.3f\t%d\t%s" % (family, size, status, wall, rss,
+			"\t".join(str(stats.get(key, "-")) for key in ["calls", "hits", "misses", "solvercalls", "answersets"])), file=out)
+		out.flush()
+
+if __name__ == "__main__":
+	main()
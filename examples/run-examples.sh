@@ -0,0 +1,65 @@
+#!/bin/sh
+# Runs the examples with dlvhex and compares their answer sets to the expected ones (used by make check).
+# The dlvhex command can be set by DLVHEX (make check passes the plugin of this build), the examples are taken from srcdir.
+
+dlvhex=${DLVHEX:-dlvhex2}
+srcdir=${srcdir:-$(dirname "$0")}
+failed=0
+
+# prints the answer sets in a canonical form: the atoms of each answer set and the answer sets are sorted
+normalize(){
+	awk '{
+		s = substr($0, 2, length($0) - 2); n = 0; depth = 0; atom = ""
+		for (i = 1; i <= length(s); i++){
+			c = substr(s, i, 1)
+			if (c == "(") depth++
+			if (c == ")") depth--
+			if (c == "," && depth == 0){ atoms[++n] = atom; atom = "" }
+			else atom = atom c
+		}
+		if (atom != "") atoms[++n] = atom
+		for (i = 2; i <= n; i++){
+			a = atoms[i]
+			for (j = i - 1; j >= 1 && atoms[j] > a; j--) atoms[j + 1] = atoms[j]
+			atoms[j + 1] = a
+		}
+		line = "{"
+		for (i = 1; i <= n; i++) line = line (i > 1 ? "," : "") atoms[i]
+		print line "}"
+	}' | sort
+}
+
+# expect <program> <expected answer sets (one per line)> [dlvhex options]
+expect(){
+	program=$1
+	expected=$(printf '%s\n' "$2" | normalize)
+	shift 2
+	actual=$($dlvhex --silent "$@" "$srcdir/$program" | normalize)
+	if [ "$expected" != "$actual" ]; then
+		echo "FAIL: $program $*"
+		echo "expected:"
+		echo "$expected"
+		echo "actual:"
+		echo "$actual"
+		failed=1
+	else
+		echo "PASS: $program $*"
+	fi
+}
+
+# &hexInspection program queries count the answer sets of the subprogram
+expect count.hex "{count(4)}" --filter=count
+
+# support sets of a recursive subprogram (learned but not complete)
+for options in "" "--supportsets"; do
+	expect reachability.hex "{reached(a),reached(b),reached(c)}
+{reached(a),reached(b),reached(c),reached(d)}" --filter=reached $options
+done
+
+# support sets for facts and input atoms over the query predicate and for a chain of three derivations
+for options in "" "--supportsets"; do
+	expect supportsets.hex "{out(a)}
+{out(a),out(b),out(c),out(d),out(f)}" --filter=out $options
+done
+
+exit $failed
@@ -0,0 +1,191 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file AnswerCache.h
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Cache for the answers of nested HEX-programs.
+ */
+
+#ifndef ANSWERCACHE__HPP_INCLUDED_
+#define ANSWERCACHE__HPP_INCLUDED_
+
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/ProgramCtx.h"
+#include "dlvhex2/Interpretation.h"
+#include "Subprogram.h"
+
+#include <boost/unordered_map.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/logic/tribool.hpp>
+#include <map>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// order-independent hash over the set bits of an interpretation;
+// since it is a sum over the single atoms, it can be maintained incrementally while atoms are added or removed
+class InputFingerprint{
+private:
+	std::size_t value;
+	static std::size_t mix(IDAddress adr);
+public:
+	InputFingerprint() : value(0) {}
+	InputFingerprint(const Interpretation& intr);
+
+	void add(IDAddress adr){ value += mix(adr); }
+	void remove(IDAddress adr){ value -= mix(adr); }
+	std::size_t getValue() const{ return value; }
+};
+
+// the answer of a subprogram P under input facts F;
+// entries are created before evaluation and are filled lazily with the information which is actually requested
+struct HexAnswer{
+	ID type;			// type and program parameter of the call which created the answer (for diagnostics only)
+	ID program;
+	SubprogramPtr subprogram;
+	InterpretationPtr input;
+	std::size_t inputFingerprint;
+	// atoms which are known to be in the answer set of a monotone subprogram (taken from an answer for a smaller input);
+	// they are added as facts during evaluation
+	InterpretationPtr lowerBound;
+
+	// consistency of P \cup F (unknown as long as it has not been evaluated)
+	boost::logic::tribool consistent;
+
+	// answer sets in the order in which they were found (all of them if answersetsComputed is set);
+	// for each of them, the constraint which excludes it is stored such that the enumeration can be resumed
+	bool answersetsComputed;
+	std::vector<InterpretationPtr> answersets;
+	std::vector<ID> blockingConstraints;
+
+	// number of answer sets if it is known, -1 otherwise
+	int answersetCount;
+
+	// intersection and union of all answer sets, which are kept instead of the answer sets themselves
+	// if the subprogram is not inspected (unset as long as not all answer sets have been folded into them)
+	InterpretationPtr answersetIntersection;
+	InterpretationPtr answersetUnion;
+
+	// cautious and brave consequences over single query predicates, which were computed without enumerating all answer sets
+	std::map<ID, InterpretationPtr> cautiousConsequences;
+	std::map<ID, InterpretationPtr> braveConsequences;
+
+	// output of previous queries by (external predicate, query predicate) resp. (inspection query type, predicate),
+	// which is copied for repeated queries (cautious and brave queries only for consistent answers, where the output does not depend on the query pattern)
+	typedef boost::shared_ptr<const std::vector<Tuple> > OutputTuplesPtr;
+	std::map<std::pair<ID, ID>, OutputTuplesPtr> outputTuples;
+	// for inspected subprograms: the output of &hexInspection queries of type answerset for the i-th answer set,
+	// i.e., pairs (a, n) of the address a and the arity n of all non-auxiliary atoms in it
+	std::vector<OutputTuplesPtr> answersetAtoms;
+
+	// bookkeeping for the eviction strategy of the cache
+	double evaluationTime;		// in seconds
+	std::size_t memoryUsage;	// in bytes
+	double priority;
+
+	HexAnswer() : inputFingerprint(0), consistent(boost::logic::indeterminate), answersetsComputed(false), answersetCount(-1), evaluationTime(0), memoryUsage(0), priority(0) {}
+
+	// estimates the number of bytes held by this entry
+	std::size_t estimateMemoryUsage() const;
+};
+typedef boost::shared_ptr<HexAnswer> HexAnswerPtr;
+
+// stores answers of subprograms indexed by (subprogram, input fingerprint);
+// the full comparison of the input is only done to confirm a hash match.
+//
+// Entries are shared pointers, i.e., they are never moved or copied by the cache and remain valid
+// for callers which still hold them after they have been evicted.
+// If a memory limit is set, entries are evicted according to the GreedyDual-Size strategy:
+// the priority of an entry is the clock value plus its evaluation time per byte,
+// the entry with the lowest priority is evicted first and its priority becomes the new clock value.
+// Thus entries which were cheap to compute but are large are evicted first, while unused entries age over time.
+class AnswerCache{
+private:
+	typedef boost::unordered_multimap<std::size_t, HexAnswerPtr> Index;
+	Index index;
+	typedef std::multimap<double, HexAnswerPtr> EvictionQueue;
+	EvictionQueue evictionQueue;
+	typedef boost::unordered_multimap<const Subprogram*, HexAnswerPtr> SubprogramIndex;
+	SubprogramIndex bySubprogram;
+	// answers of monotone subprograms by the number of input atoms, such that findBounds only inspects
+	// smaller inputs as candidates for subsets and larger ones as candidates for supersets
+	typedef std::multimap<std::size_t, HexAnswerPtr> InputSizeIndex;
+	typedef boost::unordered_map<const Subprogram*, InputSizeIndex> BoundIndex;
+	BoundIndex byInputSize;
+
+	// maximum number of evaluated candidates which findBounds checks for a subset resp. a superset of the input
+	static const std::size_t maxBoundCandidates = 32;
+
+	std::size_t memoryLimit;	// in bytes, 0 means unlimited
+	std::size_t memoryUsage;
+	double clock;
+
+	static std::size_t computeKey(const Subprogram& subprogram, std::size_t inputFingerprint);
+	Index::iterator locate(const HexAnswerPtr& answer);
+	void erase(Index::iterator it);
+	double computePriority(const HexAnswer& answer) const;
+	void removeFromEvictionQueue(const HexAnswerPtr& answer);
+	// true for entries which have not been evaluated yet and are thus neither charged nor evicted
+	static bool isPending(const HexAnswer& answer);
+	void evict();
+public:
+	AnswerCache() : memoryLimit(0), memoryUsage(0), clock(0) {}
+
+	// returns the cached answer or a NULL pointer if the answer is not in the cache
+	HexAnswerPtr find(SubprogramPtr subprogram, InterpretationConstPtr input, const InputFingerprint& fingerprint);
+
+	// adds an answer to the cache and evicts other entries if the memory limit is exceeded;
+	// an answer which has not been evaluated yet is kept at least until the next update()
+	void insert(HexAnswerPtr answer);
+
+	// updates the memory usage and the priority of an answer after more information has been added to it
+	// (does nothing if the answer has been evicted in the meantime)
+	void update(HexAnswerPtr answer);
+
+	// removes all answers of a subprogram
+	void remove(SubprogramPtr subprogram);
+
+	// for monotone subprograms: retrieves a fully evaluated answer for a subset of the input (lower)
+	// and a consistent fully evaluated answer for a superset of the input (upper), or NULL pointers if there are none;
+	// an inconsistent lower bound is preferred, otherwise the bounds with the largest resp. smallest answer set are chosen
+	// among the maxBoundCandidates evaluated answers whose input size is closest to the one of the input
+	void findBounds(SubprogramPtr subprogram, InterpretationConstPtr input, HexAnswerPtr& lower, HexAnswerPtr& upper);
+
+	void setMemoryLimit(std::size_t bytes);
+	std::size_t getMemoryLimit() const{ return memoryLimit; }
+	std::size_t getMemoryUsage() const{ return memoryUsage; }
+	std::size_t size() const{ return index.size(); }
+	// number of entries and memory usage of the answers of a single subprogram
+	std::size_t getEntryCount(const Subprogram* subprogram) const;
+	std::size_t getMemoryUsage(const Subprogram* subprogram) const;
+};
+
+}
+
+DLVHEX_NAMESPACE_END
+
+#endif
@@ -38,8 +38,12 @@
 #include "dlvhex2/HexGrammar.h"
 #include "dlvhex2/HexParserModule.h"
 #include "dlvhex2/ProgramCtx.h"
+#include "AnswerCache.h"
+#include "Kernels.h"
 #include <set>
 
+#include <boost/thread/mutex.hpp>
+
 DLVHEX_NAMESPACE_BEGIN
 
 namespace nestedhex{
@@ -52,7 +56,20 @@ protected:
 
 	bool positivesubprogram;
 
-	InterpretationPtr translateInputInterpretation(InterpretationConstPtr input);
+	// translation of the higher-order input, which remembers the input of the previous call
+	InputTranslator translator;
+
+	// scratch memory for aggregating answer sets, which is reused by all calls
+	bm::bvector<> scratch;
+	boost::mutex scratchMutex;
+
+	// translates the input of a query and retrieves the (possibly not yet evaluated) answer of the subprogram
+	// (resp. of its slice for the query predicate unless it is ID_FAIL)
+	HexAnswerPtr getHexAnswer(const Query& query, ID queryPredicate);
+
+	// outputs the arguments of all atoms in the given interpretation (which must be over the query predicate)
+	void addOutputTuples(InterpretationConstPtr atoms, Answer& answer);
+	void addOutputTuples(const bm::bvector<>& atoms, Answer& answer);
 public:
 	NestedHexPluginAtom(std::string predName, ProgramCtx& ctx, bool positivesubprogram = false);
 
@@ -60,30 +77,45 @@ public:
 	virtual void retrieve(const Query& query, Answer& answer, NogoodContainerPtr nogoods);
 	virtual void learnSupportSets(const Query& query, NogoodContainerPtr nogoods);
 
+	// answers the query over a (possibly not yet evaluated) answer of the subprogram;
+	// by default, all answer sets are computed and then aggregated using answerQuery
+	virtual void evaluateQuery(HexAnswerPtr hexAnswer, PredicateMaskPtr pm, const Query& query, Answer& answer);
+
 		// define an abstract method for aggregating the answer sets (this part is specific for cautious and brave queries)
 	virtual void answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer) = 0;
+	// selects the aggregate of all answer sets which is kept for subprograms that are not inspected and which answers the query
+	virtual InterpretationPtr getSummary(HexAnswerPtr hexAnswer) = 0;
 };
 
 // cautious queries
 class CHEXAtom : public NestedHexPluginAtom{
 public:
 	CHEXAtom(ProgramCtx& ctx);
+	virtual void evaluateQuery(HexAnswerPtr hexAnswer, PredicateMaskPtr pm, const Query& query, Answer& answer);
 	virtual void answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer);
+	virtual InterpretationPtr getSummary(HexAnswerPtr hexAnswer);
 };
 
 // brave queries
 class BHEXAtom : public NestedHexPluginAtom{
 public:
 	BHEXAtom(ProgramCtx& ctx);
+	virtual void evaluateQuery(HexAnswerPtr hexAnswer, PredicateMaskPtr pm, const Query& query, Answer& answer);
 	virtual void answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer);
+	virtual InterpretationPtr getSummary(HexAnswerPtr hexAnswer);
 };
 
 // inspection of hex program answers
 class IHEXAtom : public NestedHexPluginAtom{
+private:
+	// output of the query types predicate and frequency over the atoms in the mask
+	HexAnswer::OutputTuplesPtr inspectPredicate(const std::vector<InterpretationPtr>& answersets, const bm::bvector<>& mask);
+	HexAnswer::OutputTuplesPtr inspectFrequency(const std::vector<InterpretationPtr>& answersets, const bm::bvector<>& mask);
 public:
 	IHEXAtom(ProgramCtx& ctx);
 	virtual void retrieve(const Query& query, Answer& answer, NogoodContainerPtr nogoods);
 	virtual void answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer);
+	virtual InterpretationPtr getSummary(HexAnswerPtr hexAnswer);
 };
 
 }
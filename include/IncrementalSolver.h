@@ -0,0 +1,85 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file IncrementalSolver.h
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Persistent grounding and solving of ordinary subprograms under changing inputs.
+ */
+
+#ifndef INCREMENTALSOLVER__HPP_INCLUDED_
+#define INCREMENTALSOLVER__HPP_INCLUDED_
+
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/ProgramCtx.h"
+#include "dlvhex2/Interpretation.h"
+#include "dlvhex2/GenuineSolver.h"
+
+#include <boost/shared_ptr.hpp>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// evaluates a subprogram without external atoms, aggregates and weak constraints under many inputs using one ground program and solver instance:
+// the subprogram is grounded over all input atoms seen so far, where each input atom a is guessed by an auxiliary atom g
+// (rules a :- g. g :- not g'. g' :- not g.); an input is then selected by assuming g resp. not g for all of them,
+// such that the solver (including the nogoods it has learned) is reused until an input introduces a new atom
+class IncrementalSolver{
+private:
+	ProgramCtx& ctx;
+	RegistryPtr reg;
+	std::vector<ID> idb;
+	InterpretationConstPtr edb;
+
+	InterpretationPtr domain;		// input atoms a which are part of the ground program
+	std::vector<std::pair<IDAddress, ID> > selectors;	// pairs of an input atom a and the auxiliary atom g which selects it
+	InterpretationPtr guesses;		// all auxiliary atoms g
+	InterpretationPtr auxiliaries;		// all auxiliary atoms g and g' (removed from the answer sets)
+	std::vector<ID> guessRules;
+	GenuineGrounderPtr grounder;
+	AnnotatedGroundProgram groundProgram;
+	GenuineGroundSolverPtr solver;
+	std::size_t groundings;
+
+	// adds the guesses for input atoms which are not yet in the domain and grounds the extended program
+	void extend(InterpretationConstPtr input);
+public:
+	// the context must outlive the solver as the grounder and the solver keep a reference to it
+	IncrementalSolver(ProgramCtx& ctx, const std::vector<ID>& idb, InterpretationConstPtr edb);
+
+	// computes up to maxModels answer sets (0 means all) of the subprogram extended by the input facts
+	std::vector<InterpretationPtr> evaluate(InterpretationConstPtr input, int maxModels);
+
+	// number of times the subprogram was grounded so far
+	std::size_t getGroundings() const{ return groundings; }
+};
+typedef boost::shared_ptr<IncrementalSolver> IncrementalSolverPtr;
+
+}
+
+DLVHEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,88 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file Kernels.h
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Aggregation of answer sets and translation of input, separated from the external atoms such that they can be benchmarked in isolation.
+ */
+
+#ifndef KERNELS__HPP_INCLUDED_
+#define KERNELS__HPP_INCLUDED_
+
+#include "AnswerCache.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Registry.h"
+#include "dlvhex2/Interpretation.h"
+
+#include <boost/thread/mutex.hpp>
+#include <vector>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// the aggregation kernels fold the answer sets on the calling thread if threads is 1;
+// otherwise, each of the given number of threads folds a contiguous part of them and the partial results are combined at the end
+
+// computes the atoms in the mask which are true in all answer sets (cautious consequences)
+void intersectAnswerSets(const bm::bvector<>& mask, const std::vector<InterpretationPtr>& answersets, bm::bvector<>& result, int threads = 1);
+
+// computes the atoms in the mask which are true in some answer set (brave consequences);
+// if the first answer set has at least sparseMaskRatio times as many atoms as the mask, the answer sets are restricted to the mask one by one
+const std::size_t sparseMaskRatio = 4;
+void uniteAnswerSets(const bm::bvector<>& mask, const std::vector<InterpretationPtr>& answersets, bm::bvector<>& result, int threads = 1);
+
+// computes the atoms which are true in all answer sets and the ones which are true in some answer set (without restriction to a mask)
+void summarizeAnswerSets(const std::vector<InterpretationPtr>& answersets, bm::bvector<>& intersection, bm::bvector<>& unification, int threads = 1);
+
+// appends the arguments of all atoms in the set (which must be over the query predicate) to the output tuples
+void extractTuples(const Registry& reg, const bm::bvector<>& atoms, std::vector<Tuple>& tuples);
+
+// translates higher-order input p(q, k, t1, ..., tk, empty, ..., empty) into ordinary facts q(t1, ..., tk);
+// an instance is kept per external atom since successive calls usually differ only in few input atoms
+class InputTranslator{
+private:
+	// translation of higher-order input atoms (by address) to the ordinary atoms they encode, filled on first use
+	std::vector<IDAddress> translationTable;
+	// higher-order and translated input of the previous call; the next input is translated by applying the difference
+	InterpretationPtr previousHigherOrderInput;
+	InterpretationPtr previousInput;
+	InputFingerprint previousFingerprint;
+	boost::mutex mutex;
+
+	// translates a single higher-order input atom (which is validated only once); returns ID_FAIL for auxiliary input
+	ID translateAtom(RegistryPtr reg, ID emptyID, IDAddress adr);
+public:
+	// translates the higher-order input into ordinary facts and computes the fingerprint of the result on the fly;
+	// emptyID is the constant which fills the unused positions of higher-order atoms
+	InterpretationPtr translate(RegistryPtr reg, ID emptyID, InterpretationConstPtr input, InputFingerprint& fingerprint);
+};
+
+}
+
+DLVHEX_NAMESPACE_END
+
+#endif
@@ -33,6 +33,11 @@
 #define NESTEDHEX_PLUGIN__HPP_INCLUDED_
 
 #include "ExternalAtoms.h"
+#include "AnswerCache.h"
+#include "Subprogram.h"
+#include "PersistentCache.h"
+#include "SupportSets.h"
+#include "Statistics.h"
 #include "dlvhex2/PlatformDefinitions.h"
 #include "dlvhex2/PluginInterface.h"
 #include "dlvhex2/ComponentGraph.h"
@@ -41,6 +46,8 @@
 #include "dlvhex2/ProgramCtx.h"
 #include <set>
 
+#include <boost/thread/recursive_mutex.hpp>
+
 DLVHEX_NAMESPACE_BEGIN
 
 namespace nestedhex{
@@ -53,35 +60,107 @@ public:
 	friend class CHEXAtom;
 	friend class BHEXAtom;
 	friend class IHEXAtom;
-
-	struct HexAnswer{
-		ProgramCtx pc;
-		ID type;
-		ID program;
-		InterpretationPtr input;
-		std::vector<InterpretationPtr> answersets;
-	};
+	friend class SubprogramPrecompiler;
 
 	class CtxData : public PluginData
 	{
 	public:
-		std::vector<HexAnswer> cache;
+		AnswerCache cache;
+		// answers of previous runs (unset if answers are not stored on disk)
+		PersistentCachePtr persistentCache;
+		// report of the counters of all subprograms (unset if statistics are not requested)
+		StatisticsPtr statistics;
+
+		// resolution of (type, program) pairs to parsed subprograms
+		typedef std::map<std::pair<ID, ID>, SubprogramReference> SubprogramMap;
+		SubprogramMap subprograms;
+		// parsed subprograms by the hash of their normalized source code
+		typedef boost::unordered_multimap<std::size_t, SubprogramPtr> SubprogramIndex;
+		SubprogramIndex subprogramsByContent;
+		// masks of query predicates, which are shared by all calls and updated incrementally
+		std::map<ID, PredicateMaskPtr> queryMasks;
+
+		// protects the cache, the subprogram maps and the cache entries against concurrent nested calls
+		boost::recursive_mutex mutex;
 
 		NestedHexPlugin* theNestedHexPlugin;
 		bool rewrite;	// automatically rewrite HEX-atoms?
-		CtxData() : rewrite(false) {};
-		virtual ~CtxData() {};
+		bool iterativeQueries;	// answer cautious and brave queries by iterated solver calls instead of enumerating all answer sets?
+		bool incremental;	// evaluate ordinary subprograms by one persistent ground program and solver with the input as assumptions?
+		std::size_t supportSetMaxSize;	// maximum number of body literals of support set templates
+		double supportSetMaxTime;	// maximum time in seconds for computing the templates of a subprogram and a query predicate
+		std::size_t reductionThreshold;	// minimum number of answer sets which are aggregated on several threads (0 means never)
+		CtxData() : rewrite(false), iterativeQueries(false), incremental(false), supportSetMaxSize(10), supportSetMaxTime(1), reductionThreshold(10000) {};
+		virtual ~CtxData(){
+			if (!!statistics){
+				statistics->report();
+				statistics->setCache(0);
+			}
+		};
 	};
 
 private:
 	RegistryPtr reg;
+	// statistics reports which are written when the plugin is unloaded (if the context data is not destroyed before)
+	std::vector<StatisticsPtr> statistics;
 
 	// initializes the frequently used IDs
 	void prepareIDs();
 protected:
-	ID fileID, stringID, programID, answersetID, atomID, emptyID;
-
-	const HexAnswer& getHexAnswer(ProgramCtx& ctx, ID type, ID program, InterpretationPtr input);
+	ID fileID, stringID, programID, answersetID, atomID, predicateID, frequencyID, emptyID;
+	ID hexCautiousID, hexBraveID, hexInspectionID;
+
+	// parses a subprogram or retrieves it from the cache
+	SubprogramPtr getSubprogram(ProgramCtx& ctx, ID type, ID program);
+	SubprogramPtr parseSubprogram(ProgramCtx& ctx, const std::string& source, const std::string& name);
+	// drops a subprogram and all its cached answers if it is not referenced anymore
+	void releaseSubprogram(ProgramCtx& ctx, SubprogramPtr subprogram);
+	// parses all subprograms which are statically referenced in the given rules;
+	// if the rules belong to a subprogram (caller), the calls are recorded in it
+	void precompileSubprograms(ProgramCtx& ctx, const std::vector<ID>& idb, SubprogramPtr caller = SubprogramPtr());
+	// declares that an occurrence of &hexCautious or &hexBrave provides complete positive support sets
+	// if this is possible for its subprogram (and support set learning is enabled)
+	void declareSupportSets(ProgramCtx& ctx, const ExternalAtom& eatom, SubprogramPtr subprogram);
+
+	// retrieves the support set templates of a subprogram or computes them if they are not known yet
+	SupportSetTemplatesPtr getSupportSetTemplates(ProgramCtx& ctx, SubprogramPtr subprogram, ID queryPredicate, const std::set<ID>& inputPredicates);
+
+	// retrieves the mask of a query predicate (it is not updated, as the subprogram might introduce further atoms)
+	PredicateMaskPtr getQueryMask(ProgramCtx& ctx, ID predicate);
+
+	// retrieves the slice of a subprogram for a query predicate or the subprogram itself if it cannot be sliced
+	SubprogramPtr getSlice(ProgramCtx& ctx, SubprogramPtr subprogram, ID queryPredicate);
+
+	// drops the input facts which cannot influence the answer sets of the subprogram over the query predicate
+	// (such that inputs which only differ in them share one answer) and updates the fingerprint accordingly
+	InterpretationPtr projectInput(ProgramCtx& ctx, SubprogramPtr subprogram, ID queryPredicate, InterpretationPtr input, InputFingerprint& fingerprint);
+
+	// retrieves the cache entry for a subprogram (resp. its slice for the query predicate unless it is ID_FAIL)
+	// under an input or creates a new (unevaluated) one
+	HexAnswerPtr getHexAnswer(ProgramCtx& ctx, ID type, ID program, ID queryPredicate, InterpretationPtr input, const InputFingerprint& fingerprint);
+
+	// evaluates the subprogram of an answer extended by additional rules and returns up to maxModels answer sets (0 means all)
+	std::vector<InterpretationPtr> evaluateSubprogram(ProgramCtx& ctx, HexAnswerPtr answer, const std::vector<ID>& additionalRules, int maxModels);
+	// enumerates the answer sets of an answer until at least minCount of them are known (0 means all);
+	// the enumeration is resumed from the previously found ones, which keep their position
+	void computeAnswerSets(ProgramCtx& ctx, HexAnswerPtr answer, std::size_t minCount = 0);
+	// lists the non-auxiliary atoms of all answer sets of an answer for which this has not been done yet
+	void listAnswerSetAtoms(ProgramCtx& ctx, HexAnswerPtr answer);
+	// determines the number of threads for aggregating the given number of answer sets
+	int getReductionThreads(ProgramCtx& ctx, std::size_t answersetCount);
+	// computes the intersection and the union of all answer sets, which are kept in the answer instead of the answer sets
+	// (for subprograms which are not inspected, such that an entry holds only two interpretations no matter how many answer sets there are)
+	void summarizeAnswerSets(ProgramCtx& ctx, HexAnswerPtr answer);
+	// computes the number of answer sets without keeping them in the cache
+	std::size_t getAnswerSetCount(ProgramCtx& ctx, HexAnswerPtr answer);
+	// creates the constraint :- a1, ..., an (or :- not a1, ..., not an if negated is set) for all atoms ai in the interpretation
+	ID storeConstraint(InterpretationConstPtr atoms, bool negated);
+	// creates a constraint which eliminates the given answer set of an answer (but no other one)
+	ID storeBlockingConstraint(HexAnswerPtr answer, InterpretationConstPtr answerset);
+	// computes the cautious consequences over the predicate in pm using at most one solver call per candidate atom
+	InterpretationConstPtr getCautiousConsequences(ProgramCtx& ctx, HexAnswerPtr answer, ID predicate, PredicateMaskPtr pm);
+	// computes the brave consequences over the predicate in pm using at most one solver call per brave consequence
+	InterpretationConstPtr getBraveConsequences(ProgramCtx& ctx, HexAnswerPtr answer, ID predicate, PredicateMaskPtr pm);
 
 public:
 	NestedHexPlugin();
@@ -99,6 +178,9 @@ public:
 
 	virtual void setRegistry(RegistryPtr reg);
 	virtual void setupProgramCtx(ProgramCtx& ctx);
+
+	// parses the subprograms after the outer program has been parsed
+	virtual PluginRewriterPtr createRewriter(ProgramCtx& ctx);
 };
 
 }
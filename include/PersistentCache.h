@@ -0,0 +1,90 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file PersistentCache.h
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Stores answers of subprograms on disk such that they can be reused by later runs.
+ */
+
+#ifndef PERSISTENTCACHE__HPP_INCLUDED_
+#define PERSISTENTCACHE__HPP_INCLUDED_
+
+#include "AnswerCache.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Registry.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <string>
+#include <vector>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// answers are stored in one file per (subprogram, input) pair in a compact binary format;
+// since IDs are only valid within one run, atoms are stored by the strings of their terms
+// and are mapped back into the registry of the loading run.
+//
+// The file name is derived from a hash of the signature of the subprogram and of the input atoms,
+// the full signature and the input are stored in the file in order to confirm a match; the signature consists of the normalized source code
+// of the subprogram and of all subprograms it calls, such that changes of nested files invalidate the stored answers.
+// Answers of subprograms which are not inspected are stored by the intersection and the union of their answer sets instead of the answer sets.
+// Only ground atoms over constants and integers can be stored; answers which contain other (non-auxiliary) atoms are not persisted,
+// and neither are answers of subprograms whose calls are only known during evaluation; auxiliary atoms are left out.
+class PersistentCache{
+private:
+	std::string directory;
+
+	// computes the signature of a subprogram, returns false if it calls subprograms which are not known in advance
+	static bool getSignature(const Subprogram& subprogram, std::string& signature);
+	// 64-bit FNV-1a hash, which (unlike boost::hash) is the same on all platforms and library versions
+	static boost::uint64_t hash(const std::string& data);
+
+	// encodes an atom independently of the registry, returns false if it contains terms which cannot be encoded
+	static bool encodeAtom(RegistryPtr reg, IDAddress adr, std::string& code);
+	static ID decodeAtom(RegistryPtr reg, const std::string& code);
+	// encodes the input of an answer as sorted list of atoms
+	static bool encodeInput(RegistryPtr reg, InterpretationConstPtr input, std::vector<std::string>& codes);
+	std::string getFilename(const std::string& signature, const std::vector<std::string>& input) const;
+public:
+	PersistentCache(const std::string& directory);
+
+	// fills an answer which has been created for a subprogram and an input with the stored information;
+	// returns false if there is no stored answer
+	bool load(RegistryPtr reg, HexAnswerPtr answer);
+	// writes the information in an answer to disk (replacing the previously stored one)
+	void store(RegistryPtr reg, HexAnswerPtr answer);
+
+	const std::string& getDirectory() const{ return directory; }
+};
+typedef boost::shared_ptr<PersistentCache> PersistentCachePtr;
+
+}
+
+DLVHEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,72 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file Statistics.h
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Reports statistics about the evaluation of subprograms.
+ */
+
+#ifndef STATISTICS__HPP_INCLUDED_
+#define STATISTICS__HPP_INCLUDED_
+
+#include "Subprogram.h"
+#include "AnswerCache.h"
+#include "dlvhex2/PlatformDefinitions.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <string>
+#include <vector>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// collects the subprograms whose counters are reported at the end of the run;
+// the report is printed to stderr or written as tab-separated table to a file (with tabs, line breaks and backslashes in names escaped)
+class Statistics{
+private:
+	boost::mutex mutex;
+	std::string filename;		// empty for stderr
+	std::vector<SubprogramPtr> subprograms;
+	const AnswerCache* cache;	// for the memory usage per subprogram (unset after the cache has been destroyed)
+	bool reported;
+public:
+	Statistics(const std::string& filename);
+
+	void addSubprogram(SubprogramPtr subprogram);
+	void setCache(const AnswerCache* cache);
+
+	// writes the report (only the first call has an effect)
+	void report();
+};
+typedef boost::shared_ptr<Statistics> StatisticsPtr;
+
+}
+
+DLVHEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,153 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file Subprogram.h
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Parsed representation of nested HEX-programs.
+ */
+
+#ifndef SUBPROGRAM__HPP_INCLUDED_
+#define SUBPROGRAM__HPP_INCLUDED_
+
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/ProgramCtx.h"
+#include "dlvhex2/Interpretation.h"
+#include "dlvhex2/PredicateMask.h"
+#include "IncrementalSolver.h"
+
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <ctime>
+#include <map>
+#include <set>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+struct SupportSetTemplates;
+typedef boost::shared_ptr<SupportSetTemplates> SupportSetTemplatesPtr;
+struct Subprogram;
+typedef boost::shared_ptr<Subprogram> SubprogramPtr;
+
+// counters for the statistics report
+struct SubprogramStatistics{
+	std::size_t calls;		// calls of external atoms
+	std::size_t hits;		// ... which were answered from the cache
+	std::size_t misses;
+	std::size_t evaluations;	// solver calls
+	std::size_t models;		// answer sets returned by the solver calls
+	double parseTime;		// in seconds
+	double translationTime;
+	double evaluationTime;
+
+	SubprogramStatistics() : calls(0), hits(0), misses(0), evaluations(0), models(0), parseTime(0), translationTime(0), evaluationTime(0) {}
+};
+
+// a subprogram which has been parsed once and is then evaluated under different inputs;
+// subprograms are identified by their normalized source code, i.e., textually equivalent subprograms
+// share one instance (and thus also cached answers) no matter if they are given as file or string
+struct Subprogram{
+	std::string name;			// filename or beginning of the source code (for diagnostics only)
+	std::string normalizedSource;		// source code without comments and redundant whitespace
+	std::size_t hash;			// hash of normalizedSource
+	std::vector<ID> idb;			// rules of the subprogram
+	InterpretationPtr edb;			// facts of the subprogram (without input)
+	bool hasWeakConstraints;		// answer sets are optimal models, i.e., additional constraints change the semantics
+	bool monotone;				// definite program (no default negation, disjunction, aggregates or external atoms), i.e.,
+						// it has at most one answer set, which grows with the input, and inconsistency is preserved by larger inputs
+	bool hasConstraints;			// monotone subprograms without constraints have exactly one answer set
+	std::set<ID> bodyPredicates;		// predicates which occur in rule bodies (i.e., input which might influence the result)
+	std::set<ID> readPredicates;		// predicates whose input facts might influence the answer sets over other predicates:
+						// body predicates, input predicates of external atoms and predicates in disjunctive heads
+	bool readPredicatesKnown;		// unset if some rule contains atoms whose dependencies are not analyzed (e.g. aggregates)
+	bool ordinary;				// only ordinary and builtin atoms and no weak constraints, i.e., it can be evaluated by an IncrementalSolver
+	// subprograms which are called with a constant program parameter (the answers of this one depend on them);
+	// weak pointers since a subprogram may call itself
+	std::vector<boost::weak_ptr<Subprogram> > calledSubprograms;
+	bool hasDynamicCalls;			// some call has a program parameter which is only known during evaluation
+	bool inspected;				// used with &hexInspection, which needs the answer sets themselves
+						// (otherwise only their intersection and union are cached)
+	ProgramCtx pc;				// context for evaluating the subprogram, prepared once and shared by all inputs
+						// (evaluations work on copies which only differ in the EDB and additional constraints)
+	IncrementalSolverPtr solver;		// ground program and solver shared by all inputs (created on first use if enabled and the subprogram is ordinary)
+
+	// support set templates by query predicate and input predicates, computed on first use
+	typedef std::map<std::pair<ID, std::set<ID> >, SupportSetTemplatesPtr> SupportSetTemplateMap;
+	SupportSetTemplateMap supportSetTemplates;
+
+	// slices by query predicate, computed on first use (a NULL pointer if the subprogram cannot be sliced for the predicate)
+	typedef std::map<ID, SubprogramPtr> SliceMap;
+	SliceMap slices;
+
+	// masks of the read predicates and a query predicate, which select the input facts that are relevant for the query
+	std::map<ID, PredicateMaskPtr> inputMasks;
+
+	SubprogramStatistics statistics;
+
+	Subprogram() : hash(0), hasWeakConstraints(false), monotone(false), hasConstraints(false), readPredicatesKnown(false), ordinary(false), hasDynamicCalls(false), inspected(false) {}
+
+	// removes comments and all whitespace which does not separate two identifiers
+	static std::string normalize(const std::string& source);
+
+	// determines hasWeakConstraints, monotone, hasConstraints, bodyPredicates, readPredicates and ordinary from the rules
+	void analyze(RegistryPtr reg);
+
+	// computes the part of the subprogram which is relevant for the query predicate, i.e., the rules which define predicates
+	// the query predicate depends on and all constraints (together with the rules they depend on);
+	// the cautious and brave consequences over the query predicate are then the same as for the whole subprogram.
+	// Returns a NULL pointer if the slice is the whole subprogram or if the remaining rules might eliminate answer sets
+	// (e.g. by odd loops through negation), which is only excluded for positive and stratified rules without external atoms.
+	SubprogramPtr slice(RegistryPtr reg, ID queryPredicate) const;
+};
+
+// resolves the program parameter of an external atom to a subprogram;
+// for files the modification time and the size are recorded to detect changes during long runs
+struct SubprogramReference{
+	SubprogramPtr subprogram;
+	std::string filename;			// empty for string programs
+	std::time_t modificationTime;
+	boost::uintmax_t fileSize;
+	std::time_t lastCheck;			// time of the last check for changes of the file
+
+	// minimum time in seconds between two checks for changes of a file, such that calls on the hot path
+	// do not query the file system each time
+	static const std::time_t checkInterval = 1;
+
+	SubprogramReference() : modificationTime(0), fileSize(0), lastCheck(0) {}
+
+	// reads the file and records its modification time and size
+	static std::string readFile(const std::string& filename, std::time_t& modificationTime, boost::uintmax_t& fileSize);
+	// checks if the file has changed since it was read (at most once per checkInterval, otherwise it is assumed to be unchanged)
+	bool isStale();
+};
+
+}
+
+DLVHEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,107 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file SupportSets.h
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Computes nonground support set templates of subprograms.
+ */
+
+#ifndef SUPPORTSETS__HPP_INCLUDED_
+#define SUPPORTSETS__HPP_INCLUDED_
+
+#include "Subprogram.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Registry.h"
+
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <map>
+#include <set>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// a nonground support set of a subprogram: whenever all body literals (over input predicates) are true in the input,
+// then the head atom (over the query predicate) is derived
+struct SupportSetTemplate{
+	ID head;
+	std::vector<ID> body;
+
+	bool operator<(const SupportSetTemplate& other) const;
+};
+
+// the support set templates of a subprogram for a query predicate and a set of input predicates
+// (input atoms over the query predicate itself are not covered since their arity is not determined by the subprogram)
+struct SupportSetTemplates{
+	std::vector<SupportSetTemplate> templates;
+	// set if the templates contain all support sets (up to renaming), i.e., neither a bound was hit nor an unsupported construct was encountered
+	bool complete;
+	// set if the query predicate depends on a predicate which depends on itself
+	bool recursive;
+
+	SupportSetTemplates() : complete(true), recursive(false) {}
+};
+
+// computes support set templates from the facts over the query predicate (with empty body) and by unfolding the rules which derive it:
+// body atoms over input predicates are kept, all other ones are resolved with the rules (indexed by their head predicate)
+// and the facts of the subprogram, until only input literals are left.
+// Goals which repeat a goal they were derived from (up to variable renaming) are not unfolded further.
+// The search is bounded by the number of body literals of a template, the number of rules applied in an unfolding and the time spent;
+// the templates are incomplete if a bound is hit or a goal is not unfolded.
+class SupportSetGenerator{
+private:
+	RegistryPtr reg;
+	const Subprogram& subprogram;
+	std::size_t maxSize;
+	double maxTime;
+	// maximum number of rules applied in an unfolding (which also bounds the number of variables used for renaming)
+	static const std::size_t maxDepth = 32;
+
+	typedef std::multimap<ID, ID> RuleIndex;
+	RuleIndex rulesByHeadPredicate;
+	typedef std::multimap<ID, ID> FactIndex;
+	FactIndex factsByPredicate;
+
+	typedef std::map<ID, ID> Substitution;
+	ID resolve(const Substitution& subst, ID term) const;
+	bool unify(const OrdinaryAtom& a1, const OrdinaryAtom& a2, Substitution& subst) const;
+	ID substitute(const Substitution& subst, ID atomOrLiteral);
+	// renames the variables of a rule which is applied after depth other rules apart from the variables of these rules
+	void renameApart(const Rule& rule, std::size_t depth, Substitution& renaming);
+	// the predicates which occur in the bodies of rules deriving a predicate, directly or transitively
+	std::set<ID> getDependencies(ID predicate) const;
+public:
+	SupportSetGenerator(RegistryPtr reg, const Subprogram& subprogram, std::size_t maxSize, double maxTime);
+
+	SupportSetTemplatesPtr generate(ID queryPredicate, const std::set<ID>& inputPredicates);
+};
+
+}
+
+DLVHEX_NAMESPACE_END
+
+#endif
@@ -0,0 +1,335 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file AnswerCache.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Cache for the answers of nested HEX-programs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "AnswerCache.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Logger.h"
+
+#include <boost/functional/hash.hpp>
+#include <boost/foreach.hpp>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// ============================== Class InputFingerprint ==============================
+
+std::size_t InputFingerprint::mix(IDAddress adr){
+
+	// spread the bits of the address such that sums of several addresses rarely collide
+	uint64_t x = static_cast<uint64_t>(adr) + 0x9E3779B97F4A7C15ULL;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+	return static_cast<std::size_t>(x ^ (x >> 31));
+}
+
+InputFingerprint::InputFingerprint(const Interpretation& intr) : value(0){
+
+	bm::bvector<>::enumerator en = intr.getStorage().first();
+	bm::bvector<>::enumerator en_end = intr.getStorage().end();
+	while (en < en_end){
+		add(*en);
+		en++;
+	}
+}
+
+// ============================== Class HexAnswer ==============================
+
+std::size_t HexAnswer::estimateMemoryUsage() const{
+
+	std::size_t bytes = sizeof(HexAnswer);
+	bm::bvector<>::statistics st;
+	if (!!input){
+		input->getStorage().calc_stat(&st);
+		bytes += st.memory_used;
+	}
+	BOOST_FOREACH (InterpretationPtr as, answersets){
+		as->getStorage().calc_stat(&st);
+		bytes += sizeof(Interpretation) + st.memory_used;
+	}
+	if (!!answersetIntersection){
+		answersetIntersection->getStorage().calc_stat(&st);
+		bytes += sizeof(Interpretation) + st.memory_used;
+		answersetUnion->getStorage().calc_stat(&st);
+		bytes += sizeof(Interpretation) + st.memory_used;
+	}
+	typedef std::pair<ID, InterpretationPtr> QueryResult;
+	BOOST_FOREACH (const QueryResult& qr, cautiousConsequences){
+		qr.second->getStorage().calc_stat(&st);
+		bytes += sizeof(Interpretation) + st.memory_used;
+	}
+	BOOST_FOREACH (const QueryResult& qr, braveConsequences){
+		qr.second->getStorage().calc_stat(&st);
+		bytes += sizeof(Interpretation) + st.memory_used;
+	}
+	typedef std::pair<std::pair<ID, ID>, OutputTuplesPtr> Output;
+	BOOST_FOREACH (const Output& output, outputTuples){
+		bytes += sizeof(std::vector<Tuple>);
+		BOOST_FOREACH (const Tuple& t, *output.second) bytes += sizeof(Tuple) + t.size() * sizeof(ID);
+	}
+	BOOST_FOREACH (OutputTuplesPtr atoms, answersetAtoms){
+		bytes += sizeof(std::vector<Tuple>) + atoms->size() * (sizeof(Tuple) + 2 * sizeof(ID));
+	}
+	bytes += blockingConstraints.size() * sizeof(ID);
+	return bytes;
+}
+
+// ============================== Class AnswerCache ==============================
+
+std::size_t AnswerCache::computeKey(const Subprogram& subprogram, std::size_t inputFingerprint){
+
+	std::size_t key = subprogram.hash;
+	boost::hash_combine(key, inputFingerprint);
+	return key;
+}
+
+double AnswerCache::computePriority(const HexAnswer& answer) const{
+
+	// GreedyDual-Size: entries which are expensive to recompute per byte survive longer
+	return clock + answer.evaluationTime / static_cast<double>(answer.memoryUsage > 0 ? answer.memoryUsage : 1);
+}
+
+void AnswerCache::removeFromEvictionQueue(const HexAnswerPtr& answer){
+
+	std::pair<EvictionQueue::iterator, EvictionQueue::iterator> range = evictionQueue.equal_range(answer->priority);
+	for (EvictionQueue::iterator it = range.first; it != range.second; ++it){
+		if (it->second == answer){
+			evictionQueue.erase(it);
+			return;
+		}
+	}
+	assert(false && "cache entry is not in the eviction queue");
+}
+
+void AnswerCache::erase(Index::iterator it){
+
+	HexAnswerPtr answer = it->second;
+	index.erase(it);
+	std::pair<SubprogramIndex::iterator, SubprogramIndex::iterator> range = bySubprogram.equal_range(answer->subprogram.get());
+	for (SubprogramIndex::iterator sit = range.first; sit != range.second; ++sit){
+		if (sit->second == answer){
+			bySubprogram.erase(sit);
+			break;
+		}
+	}
+	if (answer->subprogram->monotone){
+		BoundIndex::iterator bit = byInputSize.find(answer->subprogram.get());
+		assert(bit != byInputSize.end() && "answer of a monotone subprogram is not in the bound index");
+		std::pair<InputSizeIndex::iterator, InputSizeIndex::iterator> sizeRange = bit->second.equal_range(answer->input->getStorage().count());
+		for (InputSizeIndex::iterator sit = sizeRange.first; sit != sizeRange.second; ++sit){
+			if (sit->second == answer){
+				bit->second.erase(sit);
+				break;
+			}
+		}
+		if (bit->second.empty()) byInputSize.erase(bit);
+	}
+	removeFromEvictionQueue(answer);
+	memoryUsage -= answer->memoryUsage;
+}
+
+AnswerCache::Index::iterator AnswerCache::locate(const HexAnswerPtr& answer){
+
+	std::pair<Index::iterator, Index::iterator> range = index.equal_range(computeKey(*answer->subprogram, answer->inputFingerprint));
+	for (Index::iterator it = range.first; it != range.second; ++it){
+		if (it->second == answer) return it;
+	}
+	return index.end();
+}
+
+bool AnswerCache::isPending(const HexAnswer& answer){
+
+	return answer.evaluationTime == 0 && !answer.answersetsComputed && answer.answersets.size() == 0 && boost::logic::indeterminate(answer.consistent);
+}
+
+void AnswerCache::evict(){
+
+	// never evict the last entry, otherwise a single large answer would prevent any caching;
+	// entries which are still to be evaluated by the caller are skipped, otherwise they would be lost before they are filled
+	EvictionQueue::iterator candidate = evictionQueue.begin();
+	while (memoryLimit > 0 && memoryUsage > memoryLimit && evictionQueue.size() > 1){
+		while (candidate != evictionQueue.end() && isPending(*candidate->second)) ++candidate;
+		if (candidate == evictionQueue.end()) break;
+		HexAnswerPtr victim = candidate->second;
+		clock = candidate->first;
+		++candidate;
+
+		Index::iterator it = locate(victim);
+		assert(it != index.end() && "entry in eviction queue is not in the cache");
+		erase(it);
+		DBGLOG(DBG, "Evicted answer from cache (" << victim->memoryUsage << " bytes, evaluation time " << victim->evaluationTime << "s), cache now uses " << memoryUsage << " bytes");
+	}
+}
+
+HexAnswerPtr AnswerCache::find(SubprogramPtr subprogram, InterpretationConstPtr input, const InputFingerprint& fingerprint){
+
+	std::pair<Index::iterator, Index::iterator> candidates = index.equal_range(computeKey(*subprogram, fingerprint.getValue()));
+	for (Index::iterator it = candidates.first; it != candidates.second; ++it){
+		HexAnswerPtr answer = it->second;
+		assert(!!answer->input && "Invalid cache entry");
+
+		// confirm the hash match
+		if ((answer->inputFingerprint == fingerprint.getValue()) && (answer->subprogram == subprogram) && (answer->input->getStorage() == input->getStorage())){
+			// refresh the priority of the entry
+			if (memoryLimit > 0){
+				removeFromEvictionQueue(answer);
+				answer->priority = computePriority(*answer);
+				evictionQueue.insert(EvictionQueue::value_type(answer->priority, answer));
+			}
+			return answer;
+		}
+		DBGLOG(DBG, "Hash collision in answer cache");
+	}
+	return HexAnswerPtr();
+}
+
+void AnswerCache::insert(HexAnswerPtr answer){
+
+	assert(!!answer->input && "Invalid cache entry");
+
+	// unevaluated entries are not charged against the memory limit before update() is called for them
+	answer->memoryUsage = (isPending(*answer) ? 0 : answer->estimateMemoryUsage());
+	answer->priority = computePriority(*answer);
+	assert(!!answer->subprogram && "Cache entry without subprogram");
+	index.insert(Index::value_type(computeKey(*answer->subprogram, answer->inputFingerprint), answer));
+	bySubprogram.insert(SubprogramIndex::value_type(answer->subprogram.get(), answer));
+	if (answer->subprogram->monotone) byInputSize[answer->subprogram.get()].insert(InputSizeIndex::value_type(answer->input->getStorage().count(), answer));
+	evictionQueue.insert(EvictionQueue::value_type(answer->priority, answer));
+	memoryUsage += answer->memoryUsage;
+	evict();
+}
+
+void AnswerCache::update(HexAnswerPtr answer){
+
+	if (locate(answer) == index.end()) return;
+
+	removeFromEvictionQueue(answer);
+	memoryUsage -= answer->memoryUsage;
+	answer->memoryUsage = answer->estimateMemoryUsage();
+	answer->priority = computePriority(*answer);
+	evictionQueue.insert(EvictionQueue::value_type(answer->priority, answer));
+	memoryUsage += answer->memoryUsage;
+	evict();
+}
+
+void AnswerCache::remove(SubprogramPtr subprogram){
+
+	std::pair<SubprogramIndex::iterator, SubprogramIndex::iterator> range = bySubprogram.equal_range(subprogram.get());
+	std::vector<HexAnswerPtr> answers;
+	for (SubprogramIndex::iterator it = range.first; it != range.second; ++it) answers.push_back(it->second);
+	BOOST_FOREACH (HexAnswerPtr answer, answers) erase(locate(answer));
+}
+
+void AnswerCache::findBounds(SubprogramPtr subprogram, InterpretationConstPtr input, HexAnswerPtr& lower, HexAnswerPtr& upper){
+
+	lower.reset();
+	upper.reset();
+	std::size_t lowerSize = 0, upperSize = 0;
+
+	BoundIndex::iterator bit = byInputSize.find(subprogram.get());
+	if (bit == byInputSize.end()) return;
+	InputSizeIndex& answers = bit->second;
+	std::size_t inputSize = input->getStorage().count();
+
+	// subsets of the input have fewer atoms; the largest ones are checked first as they give the tightest bounds
+	std::size_t checked = 0;
+	for (InputSizeIndex::reverse_iterator it(answers.lower_bound(inputSize)); it != answers.rend() && checked < maxBoundCandidates; ++it){
+		HexAnswerPtr answer = it->second;
+		if (!answer->answersetsComputed) continue;
+		checked++;
+
+		bm::bvector<> additional = answer->input->getStorage();
+		additional -= input->getStorage();
+		if (additional.any()) continue;
+
+		// inconsistency carries over to larger inputs, thus there is nothing better
+		if (answer->answersets.size() == 0){
+			lower = answer;
+			return;
+		}
+		std::size_t size = answer->answersets[0]->getStorage().count();
+		if (!lower || size > lowerSize){
+			lower = answer;
+			lowerSize = size;
+		}
+	}
+
+	// supersets of the input have more atoms; the smallest ones are checked first
+	checked = 0;
+	for (InputSizeIndex::iterator it = answers.upper_bound(inputSize); it != answers.end() && checked < maxBoundCandidates; ++it){
+		HexAnswerPtr answer = it->second;
+		if (!answer->answersetsComputed) continue;
+		checked++;
+
+		bm::bvector<> missing = input->getStorage();
+		missing -= answer->input->getStorage();
+		if (missing.any() || answer->answersets.size() == 0) continue;
+
+		std::size_t size = answer->answersets[0]->getStorage().count();
+		if (!upper || size < upperSize){
+			upper = answer;
+			upperSize = size;
+		}
+	}
+}
+
+std::size_t AnswerCache::getEntryCount(const Subprogram* subprogram) const{
+
+	return bySubprogram.count(subprogram);
+}
+
+std::size_t AnswerCache::getMemoryUsage(const Subprogram* subprogram) const{
+
+	std::size_t bytes = 0;
+	std::pair<SubprogramIndex::const_iterator, SubprogramIndex::const_iterator> range = bySubprogram.equal_range(subprogram);
+	for (SubprogramIndex::const_iterator it = range.first; it != range.second; ++it) bytes += it->second->memoryUsage;
+	return bytes;
+}
+
+void AnswerCache::setMemoryLimit(std::size_t bytes){
+
+	memoryLimit = bytes;
+	evict();
+}
+
+}
+
+DLVHEX_NAMESPACE_END
+
+/* vim: set noet sw=2 ts=2 tw=80: */
+
+// Local Variables:
+// mode: C++
+// End:
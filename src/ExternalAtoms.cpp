@@ -51,6 +51,7 @@
 #include "boost/range.hpp"
 #include "boost/foreach.hpp"
 #include "boost/filesystem.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
@@ -61,48 +62,33 @@ namespace nestedhex{
 
 // ============================== Class NestedHexPluginAtom ==============================
 
-InterpretationPtr NestedHexPluginAtom::translateInputInterpretation(InterpretationConstPtr input){
+HexAnswerPtr NestedHexPluginAtom::getHexAnswer(const Query& query, ID queryPredicate){
 
-	if (!input) return InterpretationPtr(new Interpretation(reg));
-	DBGLOG(DBG, "Translating interpretation: " << *input);
+	NestedHexPlugin::CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
 
-	RegistryPtr reg = getRegistry();
+	// the clock is only read if statistics are requested
+	boost::posix_time::ptime start;
+	if (!!ctxdata.statistics) start = boost::posix_time::microsec_clock::universal_time();
+	InputFingerprint fingerprint;
+	InterpretationPtr subprogramInput = translator.translate(getRegistry(), ctxdata.theNestedHexPlugin->emptyID, query.interpretation, fingerprint);
+	double translationTime = (!!ctxdata.statistics ? (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1000000.0 : 0);
 
-	DBGLOG(DBG, "Translating input to nested hex program");
+	HexAnswerPtr hexAnswer = ctxdata.theNestedHexPlugin->getHexAnswer(ctx, query.input[0], query.input[1], queryPredicate, subprogramInput, fingerprint);
+	if (!!ctxdata.statistics){
+		boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+		hexAnswer->subprogram->statistics.translationTime += translationTime;
+	}
+	return hexAnswer;
+}
 
-	// Translate input from higher-order notation to ordinary input
-	InterpretationPtr edb(new Interpretation(reg));
-	bm::bvector<>::enumerator en = input->getStorage().first();
-	bm::bvector<>::enumerator en_end = input->getStorage().end();
-	while (en < en_end){
-		// do not translate auxiliary input!
-		if (!reg->ogatoms.getIDByAddress(*en).isExternalInputAuxiliary()){
-			OrdinaryAtom oatom = reg->ogatoms.getByAddress(*en);
-			// check if input is valid
-			if (oatom.tuple.size() < 2) throw PluginError("Input to nested HEX programs must be of arity >= 2");
-			if (!oatom.tuple[2].isTerm() || !oatom.tuple[2].isIntegerTerm()) throw PluginError("Input to nested HEX programs must contain the arity of the mapped predicate at its second position");
-			if (oatom.tuple.size() < oatom.tuple[2].address + 3) throw PluginError("Input to nested HEX programs has an arity smaller than the specified one + 2");
-			for (int ir = 2 + oatom.tuple[2].address + 1; ir < oatom.tuple.size(); ++ir){
-				if (oatom.tuple[ir] != ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->emptyID) throw PluginError("Input to nested HEX programs must have constant empty on all attribute positions greater than the arity of the mapped predicate");
-			}
+void NestedHexPluginAtom::addOutputTuples(InterpretationConstPtr atoms, Answer& answer){
 
-			// delete all empty elements, the 2-th and the 0-nd element
-			int arity = oatom.tuple[2].address;
-			oatom.tuple.erase(oatom.tuple.begin() + 2 + oatom.tuple[2].address + 1, oatom.tuple.end());
-			oatom.tuple.erase(oatom.tuple.begin() + 2, oatom.tuple.begin() + 3);
-			oatom.tuple.erase(oatom.tuple.begin());
-			oatom.kind = ID::MAINKIND_ATOM | ID::SUBKIND_ATOM_ORDINARYG;
-			ID inputAtom = reg->storeOrdinaryAtom(oatom);
-			edb->setFact(inputAtom.address);
-#ifndef NDEBUG
-			std::string outstr = "Translated " + RawPrinter::toString(reg, reg->ogatoms.getIDByAddress(*en)) + " to " + RawPrinter::toString(reg, inputAtom);
-			DBGLOG(DBG, outstr);
-#endif
-			assert(reg->ogatoms.getByID(inputAtom).tuple.size() == arity + 1 && "Translation of input atom failed");
-		}
-		en++;
-	}
-	return edb;
+	addOutputTuples(atoms->getStorage(), answer);
+}
+
+void NestedHexPluginAtom::addOutputTuples(const bm::bvector<>& atoms, Answer& answer){
+
+	extractTuples(*getRegistry(), atoms, answer.get());
 }
 
 NestedHexPluginAtom::NestedHexPluginAtom(std::string predName, ProgramCtx& ctx, bool positivesubprogram) : PluginAtom(predName, positivesubprogram), ctx(ctx), positivesubprogram(positivesubprogram){
@@ -124,16 +110,56 @@ void NestedHexPluginAtom::retrieve(const Query& query, Answer& answer, NogoodCon
 	//	query.input[2] (i.e. p): a predicate name; the set F of all atoms over this predicate are added to P as facts before evaluation
 	//	query.input[3] (i.e. q): name of the query predicate; the external atom will be true for all output vectors x such that q(x) is true in every answer set of P \cup F
 
-	const std::vector<InterpretationPtr>& answersets = ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->getHexAnswer(ctx, query.input[0], query.input[1], translateInputInterpretation(query.interpretation)).answersets;
+	NestedHexPlugin::CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	HexAnswerPtr hexAnswer = getHexAnswer(query, query.input[3]);
+
+	// repeated queries over the same answer only copy the output of the first one
+	std::pair<ID, ID> outputKey(getPredicateID(), query.input[3]);
+	HexAnswer::OutputTuplesPtr output;
+	{
+		boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+		std::map<std::pair<ID, ID>, HexAnswer::OutputTuplesPtr>::const_iterator it = hexAnswer->outputTuples.find(outputKey);
+		if (it != hexAnswer->outputTuples.end()) output = it->second;
+	}
+	if (!!output){
+		DBGLOG(DBG, "Retrieving output tuples from cache");
+		answer.get().insert(answer.get().end(), output->begin(), output->end());
+		return;
+	}
+
+	// the mask for the query predicate is shared by all calls, i.e., an update only needs to inspect atoms which are new since the previous one
+	// (the mask is updated after evaluation as the subprogram might introduce new atoms)
+	PredicateMaskPtr pm = ctxdata.theNestedHexPlugin->getQueryMask(ctx, query.input[3]);
+
+	std::size_t previousSize = answer.get().size();
+	evaluateQuery(hexAnswer, pm, query, answer);
+
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	if (hexAnswer->consistent){
+		hexAnswer->outputTuples[outputKey] = HexAnswer::OutputTuplesPtr(new std::vector<Tuple>(answer.get().begin() + previousSize, answer.get().end()));
+		ctxdata.cache.update(hexAnswer);
+	}
+}
+
+void NestedHexPluginAtom::evaluateQuery(HexAnswerPtr hexAnswer, PredicateMaskPtr pm, const Query& query, Answer& answer){
 
-	// create a mask for the query predicate, i.e., retrieve all atoms over the query predicate
-	PredicateMaskPtr pm = PredicateMaskPtr(new PredicateMask());
-	pm->setRegistry(reg);
-	pm->addPredicate(query.input[3]);
+	// if the subprogram is not inspected (and may have several answer sets), only the intersection and the union of its answer sets are kept;
+	// the query is then answered over the respective one of them, which is equivalent to aggregating all answer sets
+	if (!!hexAnswer->answersetIntersection || (!hexAnswer->answersetsComputed && !hexAnswer->subprogram->inspected && !hexAnswer->subprogram->monotone)){
+		ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->summarizeAnswerSets(ctx, hexAnswer);
+		pm->updateMask();
+
+		std::vector<InterpretationPtr> summary;
+		if (hexAnswer->consistent) summary.push_back(getSummary(hexAnswer));
+		answerQuery(pm, summary, query, answer);
+		return;
+	}
+
+	ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->computeAnswerSets(ctx, hexAnswer);
 	pm->updateMask();
 
 	// now since we know all answer sets, we can answer the query
-	answerQuery(pm, answersets, query, answer);
+	answerQuery(pm, hexAnswer->answersets, query, answer);
 }
 
 void NestedHexPluginAtom::learnSupportSets(const Query& query, NogoodContainerPtr nogoods){
@@ -146,107 +172,86 @@ void NestedHexPluginAtom::learnSupportSets(const Query& query, NogoodContainerPt
 	//	query.input[2] (i.e. p): a predicate name; the set F of all atoms over this predicate are added to P as facts before evaluation
 	//	query.input[3] (i.e. q): name of the query predicate; the external atom will be true for all output vectors x such that q(x) is true in every answer set of P \cup F
 
-	const NestedHexPlugin::HexAnswer& answer = ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->getHexAnswer(ctx, query.input[0], query.input[1], translateInputInterpretation(query.interpretation));
-	const std::vector<InterpretationPtr>& answersets = answer.answersets;
-
 	// learn support sets (only if --supportsets option is specified on the command line)
-	if (!!nogoods && !!nogoods && query.ctx->config.getOption("SupportSets")){
-		SimpleNogoodContainerPtr preparedNogoods = SimpleNogoodContainerPtr(new SimpleNogoodContainer());
-
-		// for all rules r of P
-		BOOST_FOREACH (ID ruleID, answer.pc.idb){
-			const Rule& rule = reg->rules.getByID(ruleID);
-
-			// Check if r is a rule of form
-			//			hatom :- B,
-			// where hatom is a single atom and B contains only positive atoms.
-			bool posBody = true;
-			BOOST_FOREACH (ID b, rule.body){
-				if (b.isNaf()) posBody = false;
-			}
-			if (rule.head.size() == 1 /*&& posBody*/){
-				// We learn the following (nonground) nogoods: { T b | b \in B } \cup { F hatom }.
-				Nogood nogood;
-
-				// add all (positive) body atoms
-				BOOST_FOREACH (ID blit, rule.body) nogood.insert(NogoodContainer::createLiteral(blit));
+	if (!nogoods || !query.ctx->config.getOption("SupportSets")) return;
 
-				// add the negated head atom
-				nogood.insert(NogoodContainer::createLiteral(rule.head[0] | ID(ID::NAF_MASK, 0)));
-
-				// actually learn this nogood
-				DBGLOG(DBG, "Learn prepared nogood " << nogood.getStringRepresentation(reg));
-				preparedNogoods->addNogood(nogood);
-			}
-		}
-
-		// exhaustively generate all resolvents of the prepared nogoods
-		DBGLOG(DBG, "Computing resolvents of prepared nogoods up to size " << (query.interpretation->getStorage().count() + 1));
-		preparedNogoods->addAllResolvents(reg, query.interpretation->getStorage().count() + 1);
+	NestedHexPlugin* theNestedHexPlugin = ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin;
+	SubprogramPtr subprogram = theNestedHexPlugin->getSubprogram(ctx, query.input[0], query.input[1]);
 
-		// make a list of input predicates and their arities
-		InterpretationPtr inputPredicates(new Interpretation(reg));
-		std::map<IDAddress, int> aritiy;
-		int maxarity = 0;
-		bm::bvector<>::enumerator en = query.interpretation->getStorage().first();
-		bm::bvector<>::enumerator en_end = query.interpretation->getStorage().end();
-		while (en < en_end){
+	// determine the arity of the input predicate p (the interpretation contains all atoms over p which might be input)
+	int maxarity = 0;
+	bm::bvector<>::enumerator en = query.interpretation->getStorage().first();
+	bm::bvector<>::enumerator en_end = query.interpretation->getStorage().end();
+	while (en < en_end){
+		if (!reg->ogatoms.getIDByAddress(*en).isExternalInputAuxiliary()){
 			const OrdinaryAtom& ogatom = reg->ogatoms.getByAddress(*en);
 			assert(ogatom.tuple.size() >= 3 && "invalid input atom");
-			inputPredicates->setFact(ogatom.tuple[1].address);
-			aritiy[ogatom.tuple[1].address] = ogatom.tuple.size() - 3;
-			if (aritiy[ogatom.tuple[1].address] > maxarity) maxarity = aritiy[ogatom.tuple[1].address];
-			en++;
-		}		
-
-		// all nogoods of form
-		//		{ T b | b \in B } \cup { F q(X) }
-		// containing only atoms over p and q are transformed into support sets of form
-		//		{ T b | b \in B } \cup { F e_{&testCautiousQuery["prog", p, q]}(X) }
-		// This is because if all body atoms are in the input (atoms over predicate p), then q(X) is true in every answer set of P \cup F.
-		// But then, since q is the query predicate, also &testCautiousQuery["prog", p, q](X) is true.
-		DBGLOG(DBG, "Extracting support sets from prepared nogoods");
-		for (int i = 0; i < preparedNogoods->getNogoodCount(); i++){
-			const Nogood& ng = preparedNogoods->getNogood(i);
-			bool isSupportSet = true;
-			Nogood supportSet;
-			BOOST_FOREACH (ID id, ng){
-				ID pred = reg->lookupOrdinaryAtom(id).tuple[0];
-				if (inputPredicates->getFact(pred.address)){
-					// translate to higher-order notation
-					const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(id.address);
-					OrdinaryAtom hoatom(ID::MAINKIND_ATOM | ID::SUBKIND_ATOM_ORDINARYG);
-					hoatom.tuple.push_back(query.input[2]);			// auxiliary input
-					hoatom.tuple.push_back(ID::termFromInteger(maxarity));	// auxiliary input
-					hoatom.tuple.insert(hoatom.tuple.end(), oatom.tuple.begin(), oatom.tuple.end());
-					while  (hoatom.tuple.size() < maxarity + 2) hoatom.tuple.push_back(ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->emptyID);
-					ID hoatomID = reg->storeOrdinaryAtom(hoatom);
-#ifndef NDEBUG
-					std::string dbgstr = "Translated " + RawPrinter::toString(reg, reg->ogatoms.getIDByAddress(id.address)) + " to " + RawPrinter::toString(reg, hoatomID);
-					DBGLOG(DBG, dbgstr);
-#endif
-					supportSet.insert(id);
-				}else if (pred == query.input[3]){
-					const OrdinaryAtom& hatom = reg->lookupOrdinaryAtom(id);
-					// add e_{&testCautiousQuery["prog", p, q]}(X) using a helper function	
-					supportSet.insert(NogoodContainer::createLiteral(
-															ExternalLearningHelper::getOutputAtom(
-																	query,	// this parameter is always the same
-																	Tuple(hatom.tuple.begin() + 1, hatom.tuple.end()),	// hatom.tuple[0]=q and hatom.tuple[i] for i >= 1 stores the elements of X;
-																																											// here we need only the X and use hatom.tuple.begin() + 1 to eliminate the predicate q
-																	!id.isNaf() /* technical detail, is set to true almost always */).address,
-															true,																								// sign of the literal e_{&testCautiousQuery["prog", p, q]}(X) in the nogood
-															id.isOrdinaryGroundAtom()															/* specify if this literal is ground or nonground (the same as the head atom) */ ));
-				}else{
-					isSupportSet = false;
-					break;
-				}
-			}
-			if (isSupportSet){
-				DBGLOG(DBG, "Learn support set: " << supportSet.getStringRepresentation(reg));
-				nogoods->addNogood(supportSet);
+			maxarity = ogatom.tuple.size() - 3;
+		}
+		en++;
+	}
+
+	// the templates are computed once per subprogram and query predicate, where all predicates in rule bodies are potential input
+	// (thus they coincide with the ones used for deciding if the support sets are complete):
+	// a template { T b | b \in B } \cup { F q(X) } with all b over input predicates is instantiated to the support set
+	//		{ T b' | b' \in B' } \cup { F e_{&hexCautious["prog", p, q]}(X) },
+	// where B' is B in higher-order notation over p. This is because if all body atoms are in the input, then q(X) is derived.
+	SupportSetTemplatesPtr templates = theNestedHexPlugin->getSupportSetTemplates(ctx, subprogram, query.input[3], subprogram->bodyPredicates);
+	BOOST_FOREACH (const SupportSetTemplate& t, templates->templates){
+		Nogood supportSet;
+		bool isSupportSet = true;
+		BOOST_FOREACH (ID lit, t.body){
+			// translate to higher-order notation p(f, k, X1, ..., Xk, empty, ..., empty)
+			const OrdinaryAtom& oatom = reg->lookupOrdinaryAtom(lit);
+			if (oatom.tuple.size() - 1 > maxarity){
+				isSupportSet = false;
+				break;
 			}
+			OrdinaryAtom hoatom(ID::MAINKIND_ATOM | (lit.isOrdinaryGroundAtom() ? ID::SUBKIND_ATOM_ORDINARYG : ID::SUBKIND_ATOM_ORDINARYN));
+			hoatom.tuple.push_back(query.input[2]);
+			hoatom.tuple.push_back(oatom.tuple[0]);
+			hoatom.tuple.push_back(ID::termFromInteger(oatom.tuple.size() - 1));
+			hoatom.tuple.insert(hoatom.tuple.end(), oatom.tuple.begin() + 1, oatom.tuple.end());
+			while (hoatom.tuple.size() < maxarity + 3) hoatom.tuple.push_back(theNestedHexPlugin->emptyID);
+			supportSet.insert(NogoodContainer::createLiteral(ID::literalFromAtom(reg->storeOrdinaryAtom(hoatom), lit.isNaf())));
 		}
+		if (!isSupportSet) continue;
+
+		const OrdinaryAtom& hatom = reg->lookupOrdinaryAtom(t.head);
+		// add e_{&hexCautious["prog", p, q]}(X) using a helper function
+		supportSet.insert(NogoodContainer::createLiteral(
+												ExternalLearningHelper::getOutputAtom(
+														query,	// this parameter is always the same
+														Tuple(hatom.tuple.begin() + 1, hatom.tuple.end()),	// hatom.tuple[0]=q and hatom.tuple[i] for i >= 1 stores the elements of X
+														false /* technical detail */).address,
+												true,				// sign of the literal e_{&hexCautious["prog", p, q]}(X) in the nogood
+												t.head.isOrdinaryGroundAtom()	/* specify if this literal is ground or nonground (the same as the head atom) */ ));
+
+		DBGLOG(DBG, "Learn support set: " << supportSet.getStringRepresentation(reg));
+		nogoods->addNogood(supportSet);
+	}
+
+	// input atoms over q are copied to the answer sets, which gives the support set
+	//		{ T p(q, k, X1, ..., Xk, empty, ..., empty), F e_{&hexCautious["prog", p, q]}(X1, ..., Xk) }
+	// for the output arity k (this is needed for completeness)
+	int arity = query.pattern.size();
+	if (arity <= maxarity){
+		Tuple variables;
+		for (int i = 1; i <= arity; ++i) variables.push_back(reg->storeVariableTerm("X" + boost::lexical_cast<std::string>(i)));
+		OrdinaryAtom hoatom(ID::MAINKIND_ATOM | (arity == 0 ? ID::SUBKIND_ATOM_ORDINARYG : ID::SUBKIND_ATOM_ORDINARYN));
+		hoatom.tuple.push_back(query.input[2]);
+		hoatom.tuple.push_back(query.input[3]);
+		hoatom.tuple.push_back(ID::termFromInteger(arity));
+		hoatom.tuple.insert(hoatom.tuple.end(), variables.begin(), variables.end());
+		while (hoatom.tuple.size() < maxarity + 3) hoatom.tuple.push_back(theNestedHexPlugin->emptyID);
+		Nogood supportSet;
+		supportSet.insert(NogoodContainer::createLiteral(ID::literalFromAtom(reg->storeOrdinaryAtom(hoatom), false)));
+		supportSet.insert(NogoodContainer::createLiteral(
+												ExternalLearningHelper::getOutputAtom(query, variables, false).address,
+												true,
+												arity == 0));
+		DBGLOG(DBG, "Learn support set: " << supportSet.getStringRepresentation(reg));
+		nogoods->addNogood(supportSet);
 	}
 }
 
@@ -262,47 +267,60 @@ CHEXAtom::CHEXAtom(ProgramCtx& ctx) : NestedHexPluginAtom("hexCautious", ctx)
 	setOutputArity(0); // variable
 
 	prop.variableOutputArity = true; // the output arity of this external atom depends on the arity of the query predicate
-//	prop.supportSets = true; // we provide support sets
-//	prop.completePositiveSupportSets = true; // we even provide (positive) complete support sets
+	// support sets are only sound for some subprograms, thus they are declared for single occurrences (see NestedHexPlugin::declareSupportSets)
 }
 
-void CHEXAtom::answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer){
+void CHEXAtom::evaluateQuery(HexAnswerPtr hexAnswer, PredicateMaskPtr pm, const Query& query, Answer& answer){
 
-	RegistryPtr reg = getRegistry();
+	// enumerate and intersect the answer sets if they are known anyway or if iterative evaluation is disabled;
+	// with weak constraints, the additional constraints of the iterative method would change the optimal models;
+	// monotone subprograms have at most one answer set, which is found by a single solver call anyway
+	if (hexAnswer->answersetsComputed || !!hexAnswer->answersetIntersection || !ctx.getPluginData<NestedHexPlugin>().iterativeQueries || hexAnswer->subprogram->hasWeakConstraints || hexAnswer->subprogram->monotone){
+		NestedHexPluginAtom::evaluateQuery(hexAnswer, pm, query, answer);
+		return;
+	}
 
-	DBGLOG(DBG, "Answer cautious query");
+	DBGLOG(DBG, "Answer cautious query iteratively");
+
+	InterpretationConstPtr out = ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->getCautiousConsequences(ctx, hexAnswer, query.input[3], pm);
 
 	// special case: if there are no answer sets, cautious ground queries are trivially true, but cautious non-ground queries are always false for all ground substituions (by definition)
-	if (answersets.size() == 0){
+	if (!hexAnswer->consistent){
 		if (query.pattern.size() == 0){
 			// return the empty tuple
 			Tuple t;
 			answer.get().push_back(t);
 		}
 	}else{
+		addOutputTuples(out, answer);
+	}
+}
 
-		InterpretationPtr out = InterpretationPtr(new Interpretation(reg));
-		out->add(*pm->mask());
+void CHEXAtom::answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer){
 
-		// get the set of atoms over the query predicate which are true in all answer sets
-		BOOST_FOREACH (InterpretationPtr intr, answersets){
-			DBGLOG(DBG, "Inspecting " << *intr);
-			out->getStorage() &= intr->getStorage();
-		}
+	RegistryPtr reg = getRegistry();
 
-		// retrieve all output atoms oatom=q(c)
-		bm::bvector<>::enumerator en = out->getStorage().first();
-		bm::bvector<>::enumerator en_end = out->getStorage().end();
-		while (en < en_end){
-			const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(*en);
+	DBGLOG(DBG, "Answer cautious query");
 
-			// add c to the output
-			answer.get().push_back(Tuple(oatom.tuple.begin() + 1, oatom.tuple.end()));
-			en++;
+	// special case: if there are no answer sets, cautious ground queries are trivially true, but cautious non-ground queries are always false for all ground substituions (by definition)
+	if (answersets.size() == 0){
+		if (query.pattern.size() == 0){
+			// return the empty tuple
+			Tuple t;
+			answer.get().push_back(t);
 		}
+	}else{
+		boost::mutex::scoped_lock lock(scratchMutex);
+		intersectAnswerSets(pm->mask()->getStorage(), answersets, scratch, ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->getReductionThreads(ctx, answersets.size()));
+		addOutputTuples(scratch, answer);
 	}
 }
 
+InterpretationPtr CHEXAtom::getSummary(HexAnswerPtr hexAnswer){
+
+	return hexAnswer->answersetIntersection;
+}
+
 // ============================== Class BHEXAtom ==============================
 
 BHEXAtom::BHEXAtom(ProgramCtx& ctx) : NestedHexPluginAtom("hexBrave", ctx)
@@ -315,8 +333,22 @@ BHEXAtom::BHEXAtom(ProgramCtx& ctx) : NestedHexPluginAtom("hexBrave", ctx)
 	setOutputArity(0); // variable
 
 	prop.variableOutputArity = true; // the output arity of this external atom depends on the arity of the query predicate
-//	prop.supportSets = true; // we provide support sets
-//	prop.completePositiveSupportSets = true; // we even provide (positive) complete support sets
+	// support sets are only sound for some subprograms, thus they are declared for single occurrences (see NestedHexPlugin::declareSupportSets)
+}
+
+void BHEXAtom::evaluateQuery(HexAnswerPtr hexAnswer, PredicateMaskPtr pm, const Query& query, Answer& answer){
+
+	// enumerate and unite the answer sets if they are known anyway or if iterative evaluation is disabled;
+	// with weak constraints, the additional constraints of the iterative method would change the optimal models;
+	// monotone subprograms have at most one answer set, which is found by a single solver call anyway
+	if (hexAnswer->answersetsComputed || !!hexAnswer->answersetIntersection || !ctx.getPluginData<NestedHexPlugin>().iterativeQueries || hexAnswer->subprogram->hasWeakConstraints || hexAnswer->subprogram->monotone){
+		NestedHexPluginAtom::evaluateQuery(hexAnswer, pm, query, answer);
+		return;
+	}
+
+	DBGLOG(DBG, "Answer brave query iteratively");
+
+	addOutputTuples(ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->getBraveConsequences(ctx, hexAnswer, query.input[3], pm), answer);
 }
 
 void BHEXAtom::answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer){
@@ -325,24 +357,14 @@ void BHEXAtom::answerQuery(PredicateMaskPtr pm, const std::vector<Interpretation
 
 	DBGLOG(DBG, "Answer brave query");
 
-	InterpretationPtr out = InterpretationPtr(new Interpretation(reg));
-
-	// get the set of atoms over the query predicate which are true in all answer sets
-	BOOST_FOREACH (InterpretationPtr intr, answersets){
-		DBGLOG(DBG, "Inspecting " << *intr);
-		out->getStorage() |= (pm->mask()->getStorage() & intr->getStorage());
-	}
+	boost::mutex::scoped_lock lock(scratchMutex);
+	uniteAnswerSets(pm->mask()->getStorage(), answersets, scratch, ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->getReductionThreads(ctx, answersets.size()));
+	addOutputTuples(scratch, answer);
+}
 
-	// retrieve all output atoms oatom=q(c)
-	bm::bvector<>::enumerator en = out->getStorage().first();
-	bm::bvector<>::enumerator en_end = out->getStorage().end();
-	while (en < en_end){
-		const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(*en);
+InterpretationPtr BHEXAtom::getSummary(HexAnswerPtr hexAnswer){
 
-		// add c to the output
-		answer.get().push_back(Tuple(oatom.tuple.begin() + 1, oatom.tuple.end()));
-		en++;
-	}
+	return hexAnswer->answersetUnion;
 }
 
 // ============================== Class IHEXAtom ==============================
@@ -355,8 +377,9 @@ IHEXAtom::IHEXAtom(ProgramCtx& ctx) : NestedHexPluginAtom("hexInspection", ctx)
 	addInputPredicate(); // specifies the input to the subprogram
 	addInputConstant(); // query
 	addInputTuple(); // queries might require a further parameter
-	setOutputArity(2); // variable
+	setOutputArity(0); // variable
 
+	prop.variableOutputArity = true; // the output arity of the query types predicate and frequency depends on the arity of the inspected predicate
 //	prop.supportSets = true; // we provide support sets
 //	prop.completePositiveSupportSets = true; // we even provide (positive) complete support sets
 }
@@ -372,70 +395,169 @@ void IHEXAtom::retrieve(const Query& query, Answer& answer, NogoodContainerPtr n
 	//	query.input[0] (i.e. "type"): either "file" or "string"
 	//	query.input[1] (i.e. "prog"): filename of the program P over which we do query answering
 	//	query.input[2] (i.e. p): a predicate name; the set F of all atoms over this predicate are added to P as facts before evaluation
-	//	query.input[3] (i.e. query type): one of "program", "answerset", "atom"
-	//	query.input[4] (optional): missing if query type is "program", an answer set index if query type is "answerset", an atom index if query type is "atom"
+	//	query.input[3] (i.e. query type): one of "program", "answerset", "atom", "predicate", "frequency"
+	//	query.input[4] (optional): missing if query type is "program", an answer set index if query type is "answerset", an atom index if query type is "atom",
+	//				   a predicate if query type is "predicate" or "frequency"
 	// output:
 	//      if query type is program: pairs (i, n) for all 0 <= i <= n, where n is the number of answer sets of the program
 	//	if query type is answerset: pairs (i, a) for alle atoms with index i in the answer set, and a is the arity of the respective atom
 	//	if query type is atom: pairs (0, p) and (i, t[i]) for all 1 <= i <= a, where p is the predicate of the atom, a is its arity and t[i] is the term at argument position i
-
-	const std::vector<InterpretationPtr>& answersets = ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin->getHexAnswer(ctx, query.input[0], query.input[1], translateInputInterpretation(query.interpretation)).answersets;
+	//	if query type is predicate: tuples (i, t1, ..., tk) for all atoms q(t1, ..., tk) in answer set i, where q is the given predicate
+	//	if query type is frequency: tuples (n, t1, ..., tk) for all atoms q(t1, ..., tk) which are true in n > 0 answer sets, where q is the given predicate
 
 	NestedHexPlugin* theNestedHexPlugin = ctx.getPluginData<NestedHexPlugin>().theNestedHexPlugin;
 
+	// atom queries only inspect the registry, thus the subprogram does not need to be evaluated
+	if (query.input[3] == theNestedHexPlugin->atomID){
+		if (query.input.size() != 5) throw PluginError("hexInspection with query type \"atom\" requires 5 parameters");
+		if (!query.input[4].isTerm() || !query.input[4].isIntegerTerm() || query.input[4].address >= reg->ogatoms.getSize()) throw PluginError("hexInspection: invalid atom index");
+
+		const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(query.input[4].address);
+
+		int i = 0;
+		BOOST_FOREACH (ID param, oatom.tuple){
+			Tuple t;
+			t.push_back(ID::termFromInteger(i++));
+			t.push_back(param);
+			answer.get().push_back(t);
+		}
+		return;
+	}
+
+	// inspection needs the whole answer sets, thus the subprogram is not sliced
+	HexAnswerPtr hexAnswer = getHexAnswer(query, ID_FAIL);
+
+	// the answer sets of this subprogram must be kept from now on (also if it was not known to be inspected before evaluation)
+	{
+		boost::recursive_mutex::scoped_lock lock(ctx.getPluginData<NestedHexPlugin>().mutex);
+		hexAnswer->subprogram->inspected = true;
+	}
+
 	if (query.input[3] == theNestedHexPlugin->programID){
 		if (query.input.size() != 4) throw PluginError("hexInspection with query type \"program\" requires 4 parameters");
-		for (int i = 0; i < answersets.size(); ++i){
+
+		// only the number of answer sets is needed
+		std::size_t count = theNestedHexPlugin->getAnswerSetCount(ctx, hexAnswer);
+		for (int i = 0; i < count; ++i){
 			Tuple t;
 			t.push_back(ID::termFromInteger(i));
-			t.push_back(ID::termFromInteger(answersets.size()));
+			t.push_back(ID::termFromInteger(count));
 			answer.get().push_back(t);
 		}
 	}
 	else if (query.input[3] == theNestedHexPlugin->answersetID){
 		if (query.input.size() != 5) throw PluginError("hexInspection with query type \"answersets\" requires 5 parameters");
-		if (!query.input[4].isTerm() || !query.input[4].isIntegerTerm() || query.input[4].address >= answersets.size()) throw PluginError("hexInspection: invalid answer set index");
+		if (!query.input[4].isTerm() || !query.input[4].isIntegerTerm()) throw PluginError("hexInspection: invalid answer set index");
+
+		// only the answer sets up to the requested one are needed
+		theNestedHexPlugin->computeAnswerSets(ctx, hexAnswer, query.input[4].address + 1);
+
+		// the atoms of the answer sets are listed once (usually during evaluation) and then only copied
+		HexAnswer::OutputTuplesPtr atoms;
+		{
+			boost::recursive_mutex::scoped_lock lock(ctx.getPluginData<NestedHexPlugin>().mutex);
+			if (query.input[4].address >= hexAnswer->answersets.size()) throw PluginError("hexInspection: invalid answer set index");
+			theNestedHexPlugin->listAnswerSetAtoms(ctx, hexAnswer);
+			atoms = hexAnswer->answersetAtoms[query.input[4].address];
+		}
+		DBGLOG(DBG, "Inspecting answer set " << query.input[4].address << " with " << atoms->size() << " non-auxiliary atoms");
+		answer.get().insert(answer.get().end(), atoms->begin(), atoms->end());
+	}
+	else if (query.input[3] == theNestedHexPlugin->predicateID || query.input[3] == theNestedHexPlugin->frequencyID){
+		if (query.input.size() != 5) throw PluginError("hexInspection with query type \"predicate\" or \"frequency\" requires 5 parameters");
+		if (!query.input[4].isTerm() || !query.input[4].isConstantTerm()) throw PluginError("hexInspection: invalid predicate");
+
+		// the output is computed in one pass over all answer sets and then kept with the answer like the one of cautious and brave queries
+		std::pair<ID, ID> outputKey(query.input[3], query.input[4]);
+		HexAnswer::OutputTuplesPtr output;
+		{
+			boost::recursive_mutex::scoped_lock lock(ctx.getPluginData<NestedHexPlugin>().mutex);
+			std::map<std::pair<ID, ID>, HexAnswer::OutputTuplesPtr>::const_iterator it = hexAnswer->outputTuples.find(outputKey);
+			if (it != hexAnswer->outputTuples.end()) output = it->second;
+		}
+		if (!output){
+			theNestedHexPlugin->computeAnswerSets(ctx, hexAnswer);
+			PredicateMaskPtr pm = theNestedHexPlugin->getQueryMask(ctx, query.input[4]);
+			pm->updateMask();
+			if (query.input[3] == theNestedHexPlugin->predicateID) output = inspectPredicate(hexAnswer->answersets, pm->mask()->getStorage());
+			else output = inspectFrequency(hexAnswer->answersets, pm->mask()->getStorage());
+
+			boost::recursive_mutex::scoped_lock lock(ctx.getPluginData<NestedHexPlugin>().mutex);
+			hexAnswer->outputTuples[outputKey] = output;
+			ctx.getPluginData<NestedHexPlugin>().cache.update(hexAnswer);
+		}
+		answer.get().insert(answer.get().end(), output->begin(), output->end());
+	}
+	else{
+		throw PluginError("hexInspection was called with invalid query type");
+	}
+}
 
-		DBGLOG(DBG, "Inspecting answer set: " << *answersets[query.input[4].address]);
-		bm::bvector<>::enumerator en = answersets[query.input[4].address]->getStorage().first();
-		bm::bvector<>::enumerator en_end = answersets[query.input[4].address]->getStorage().end();
-		while (en < en_end){
-			// do not output auxiliary atoms
-			if (!reg->ogatoms.getIDByAddress(*en).isAuxiliary()){
-				const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(*en);
-
-				Tuple t;
-				t.push_back(ID::termFromInteger(*en));
-				t.push_back(ID::termFromInteger(oatom.tuple.size() - 1));
-				answer.get().push_back(t);
-			}
+HexAnswer::OutputTuplesPtr IHEXAtom::inspectPredicate(const std::vector<InterpretationPtr>& answersets, const bm::bvector<>& mask){
 
+	RegistryPtr reg = getRegistry();
+	std::vector<Tuple>* output = new std::vector<Tuple>();
+	HexAnswer::OutputTuplesPtr outputPtr(output);
+	bm::bvector<> atoms;
+	for (std::size_t i = 0; i < answersets.size(); ++i){
+		atoms = answersets[i]->getStorage();
+		atoms &= mask;
+		bm::bvector<>::enumerator en = atoms.first();
+		bm::bvector<>::enumerator en_end = atoms.end();
+		while (en < en_end){
+			const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(*en);
+			Tuple t;
+			t.reserve(oatom.tuple.size());
+			t.push_back(ID::termFromInteger(i));
+			t.insert(t.end(), oatom.tuple.begin() + 1, oatom.tuple.end());
+			output->push_back(t);
 			en++;
 		}
 	}
-	else if (query.input[3] == theNestedHexPlugin->atomID){
-		if (query.input.size() != 5) throw PluginError("hexInspection with query type \"atom\" requires 5 parameters");
-		if (!query.input[4].isTerm() || !query.input[4].isIntegerTerm() || query.input[4].address >= reg->ogatoms.getSize()) throw PluginError("hexInspection: invalid atom index");
+	return outputPtr;
+}
 
-		const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(query.input[4].address);
+HexAnswer::OutputTuplesPtr IHEXAtom::inspectFrequency(const std::vector<InterpretationPtr>& answersets, const bm::bvector<>& mask){
 
-		int i = 0;
-		BOOST_FOREACH (ID param, oatom.tuple){
-			Tuple t;
-			t.push_back(ID::termFromInteger(i++));
-			t.push_back(param);
-			answer.get().push_back(t);
+	RegistryPtr reg = getRegistry();
+
+	// count the answer sets per atom over the predicate
+	std::map<IDAddress, std::size_t> frequency;
+	bm::bvector<> atoms;
+	BOOST_FOREACH (InterpretationPtr intr, answersets){
+		atoms = intr->getStorage();
+		atoms &= mask;
+		bm::bvector<>::enumerator en = atoms.first();
+		bm::bvector<>::enumerator en_end = atoms.end();
+		while (en < en_end){
+			frequency[*en]++;
+			en++;
 		}
 	}
-	else{
-		throw PluginError("hexInspection was called with invalid query type");
+
+	std::vector<Tuple>* output = new std::vector<Tuple>();
+	HexAnswer::OutputTuplesPtr outputPtr(output);
+	typedef std::pair<IDAddress, std::size_t> Frequency;
+	BOOST_FOREACH (const Frequency& f, frequency){
+		const OrdinaryAtom& oatom = reg->ogatoms.getByAddress(f.first);
+		Tuple t;
+		t.reserve(oatom.tuple.size());
+		t.push_back(ID::termFromInteger(f.second));
+		t.insert(t.end(), oatom.tuple.begin() + 1, oatom.tuple.end());
+		output->push_back(t);
 	}
+	return outputPtr;
 }
 
 void IHEXAtom::answerQuery(PredicateMaskPtr pm, const std::vector<InterpretationPtr>& answersets, const Query& query, Answer& answer){
 	assert(false);
 }
 
+InterpretationPtr IHEXAtom::getSummary(HexAnswerPtr hexAnswer){
+	assert(false);
+	return InterpretationPtr();
+}
+
 }
 
 DLVHEX_NAMESPACE_END
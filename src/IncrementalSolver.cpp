@@ -0,0 +1,144 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file IncrementalSolver.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Persistent grounding and solving of ordinary subprograms under changing inputs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "IncrementalSolver.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Registry.h"
+#include "dlvhex2/Logger.h"
+#include "dlvhex2/OrdinaryASPProgram.h"
+#include "dlvhex2/AnnotatedGroundProgram.h"
+
+#include "boost/foreach.hpp"
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// ============================== Class IncrementalSolver ==============================
+
+IncrementalSolver::IncrementalSolver(ProgramCtx& ctx, const std::vector<ID>& idb, InterpretationConstPtr edb) : ctx(ctx), reg(ctx.registry()), idb(idb), edb(edb), groundings(0){
+
+	domain = InterpretationPtr(new Interpretation(reg));
+	guesses = InterpretationPtr(new Interpretation(reg));
+	auxiliaries = InterpretationPtr(new Interpretation(reg));
+}
+
+void IncrementalSolver::extend(InterpretationConstPtr input){
+
+	bm::bvector<> newAtoms = input->getStorage();
+	newAtoms -= domain->getStorage();
+	if (!newAtoms.any() && !!solver) return;
+
+	bm::bvector<>::enumerator en = newAtoms.first();
+	bm::bvector<>::enumerator en_end = newAtoms.end();
+	while (en < en_end){
+		ID atomID = reg->ogatoms.getIDByAddress(*en);
+		ID guess = reg->getAuxiliaryAtom('i', atomID);
+		ID complement = reg->getAuxiliaryAtom('j', atomID);
+
+		// a :- g.
+		Rule select(ID::MAINKIND_RULE | ID::SUBKIND_RULE_REGULAR);
+		select.head.push_back(atomID);
+		select.body.push_back(ID::posLiteralFromAtom(guess));
+		guessRules.push_back(reg->storeRule(select));
+
+		// g :- not g'.  g' :- not g.
+		// (the input atom itself is not guessed, otherwise it could not be derived by the subprogram if it is not selected)
+		Rule in(ID::MAINKIND_RULE | ID::SUBKIND_RULE_REGULAR);
+		in.head.push_back(guess);
+		in.body.push_back(ID::nafLiteralFromAtom(complement));
+		guessRules.push_back(reg->storeRule(in));
+		Rule out(ID::MAINKIND_RULE | ID::SUBKIND_RULE_REGULAR);
+		out.head.push_back(complement);
+		out.body.push_back(ID::nafLiteralFromAtom(guess));
+		guessRules.push_back(reg->storeRule(out));
+
+		domain->setFact(*en);
+		selectors.push_back(std::pair<IDAddress, ID>(*en, guess));
+		guesses->setFact(guess.address);
+		auxiliaries->setFact(guess.address);
+		auxiliaries->setFact(complement.address);
+		en++;
+	}
+
+	DBGLOG(DBG, "Grounding subprogram over " << selectors.size() << " input atoms");
+	std::vector<ID> rules = idb;
+	rules.insert(rules.end(), guessRules.begin(), guessRules.end());
+	OrdinaryASPProgram program(reg, rules, edb);
+
+	// the guesses are assumed by the solver and must thus not be eliminated during preprocessing
+	grounder = GenuineGrounder::getInstance(ctx, program, guesses);
+	groundProgram = AnnotatedGroundProgram(ctx, grounder->getGroundProgram());
+	solver = GenuineGroundSolver::getInstance(ctx, groundProgram, guesses);
+	groundings++;
+}
+
+std::vector<InterpretationPtr> IncrementalSolver::evaluate(InterpretationConstPtr input, int maxModels){
+
+	extend(input);
+
+	// g for the atoms of the input, not g for all other atoms of the domain
+	std::vector<ID> assumptions;
+	typedef std::pair<IDAddress, ID> Selector;
+	BOOST_FOREACH (const Selector& selector, selectors){
+		assumptions.push_back(input->getFact(selector.first) ? ID::posLiteralFromAtom(selector.second) : ID::nafLiteralFromAtom(selector.second));
+	}
+	solver->restartWithAssumptions(assumptions);
+
+	std::vector<InterpretationPtr> answersets;
+	int count = 0;
+	InterpretationConstPtr model;
+	while ((maxModels == 0 || count < maxModels) && !!(model = solver->getNextModel())){
+		// the model is owned by the solver
+		InterpretationPtr answerset(new Interpretation(reg));
+		answerset->add(*model);
+		answerset->getStorage() -= auxiliaries->getStorage();
+		answerset->add(*edb);
+		count++;
+		answersets.push_back(answerset);
+	}
+	DBGLOG(DBG, "Found " << count << " answer sets with the incremental solver");
+	return answersets;
+}
+
+}
+
+DLVHEX_NAMESPACE_END
+
+/* vim: set noet sw=2 ts=2 tw=80: */
+
+// Local Variables:
+// mode: C++
+// End:
@@ -0,0 +1,278 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file Kernels.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Aggregation of answer sets and translation of input, separated from the external atoms such that they can be benchmarked in isolation.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "Kernels.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/PluginInterface.h"
+#include "dlvhex2/Printer.h"
+#include "dlvhex2/Logger.h"
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/function.hpp>
+#include <boost/thread/thread.hpp>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+// ============================== Aggregation ==============================
+
+namespace{
+	// folds the answer sets in [begin, end) into result
+	typedef boost::function<void (std::size_t, std::size_t, bm::bvector<>*)> FoldFunction;
+
+	// intersects (resp. unites) result with the answer sets in [begin, end)
+	void fold(const std::vector<InterpretationPtr>& answersets, std::size_t begin, std::size_t end, bool intersection, bm::bvector<>* result){
+		for (std::size_t i = begin; i < end; ++i){
+			DBGLOG(DBG, "Inspecting " << *answersets[i]);
+			if (intersection) *result &= answersets[i]->getStorage();
+			else *result |= answersets[i]->getStorage();
+		}
+	}
+
+	// unites result with the atoms of the mask in the answer sets in [begin, end);
+	// only the atoms of the mask which have not been found yet are intersected with each answer set,
+	// and the remaining answer sets are skipped once all of them have been found
+	void foldMasked(const std::vector<InterpretationPtr>& answersets, std::size_t begin, std::size_t end, const bm::bvector<>* mask, bm::bvector<>* result){
+		bm::bvector<> remaining = *mask;
+		remaining -= *result;
+		for (std::size_t i = begin; i < end && remaining.any(); ++i){
+			DBGLOG(DBG, "Inspecting " << *answersets[i]);
+			bm::bvector<> found = remaining;
+			found &= answersets[i]->getStorage();
+			*result |= found;
+			remaining -= found;
+		}
+	}
+
+	// folds count answer sets into result, which holds the initial value;
+	// with several threads, each part starts from the initial value and the partial results are folded into result
+	void reduce(const FoldFunction& fold, std::size_t count, bool intersection, int threads, bm::bvector<>& result){
+		// parts of a few answer sets are not worth a thread
+		if (threads > 1 && count / threads < 2) threads = count / 2;
+		if (threads <= 1){
+			fold(0, count, &result);
+			return;
+		}
+
+		DBGLOG(DBG, "Folding " << count << " answer sets on " << threads << " threads");
+		std::vector<bm::bvector<> > partial(threads, result);
+		std::size_t partSize = (count + threads - 1) / threads;
+		boost::thread_group group;
+		for (int t = 0; t < threads; ++t){
+			std::size_t begin = std::min(t * partSize, count);
+			std::size_t end = std::min(begin + partSize, count);
+			group.create_thread(boost::bind(fold, begin, end, &partial[t]));
+		}
+		group.join_all();
+
+		BOOST_FOREACH (const bm::bvector<>& p, partial){
+			if (intersection) result &= p;
+			else result |= p;
+		}
+	}
+
+	void reduce(const std::vector<InterpretationPtr>& answersets, bool intersection, int threads, bm::bvector<>& result){
+		reduce(boost::bind(&fold, boost::cref(answersets), _1, _2, intersection, _3), answersets.size(), intersection, threads, result);
+	}
+}
+
+void intersectAnswerSets(const bm::bvector<>& mask, const std::vector<InterpretationPtr>& answersets, bm::bvector<>& result, int threads){
+
+	// get the set of atoms over the query predicate which are true in all answer sets
+	// (starting from the mask keeps the intermediate results small)
+	result = mask;
+	reduce(answersets, true, threads, result);
+}
+
+void uniteAnswerSets(const bm::bvector<>& mask, const std::vector<InterpretationPtr>& answersets, bm::bvector<>& result, int threads){
+
+	// get the set of atoms over the query predicate which are true in some answer set
+	result.clear();
+	if (answersets.size() == 0) return;
+
+	// if the mask is small compared to the answer sets, only the atoms of the mask are folded (which also allows for stopping early);
+	// otherwise, the answer sets are united as they are and restricted to the query predicate once at the end,
+	// which saves the intersection with the mask per answer set
+	if (mask.count() * sparseMaskRatio <= answersets[0]->getStorage().count()){
+		reduce(boost::bind(&foldMasked, boost::cref(answersets), _1, _2, &mask, _3), answersets.size(), false, threads, result);
+	}else{
+		reduce(answersets, false, threads, result);
+		result &= mask;
+	}
+}
+
+void summarizeAnswerSets(const std::vector<InterpretationPtr>& answersets, bm::bvector<>& intersection, bm::bvector<>& unification, int threads){
+
+	intersection.clear();
+	unification.clear();
+	if (answersets.size() == 0) return;
+	intersection = answersets[0]->getStorage();
+	reduce(answersets, true, threads, intersection);
+	reduce(answersets, false, threads, unification);
+}
+
+void extractTuples(const Registry& reg, const bm::bvector<>& atoms, std::vector<Tuple>& tuples){
+
+	// retrieve all output atoms oatom=q(c)
+	bm::bvector<>::enumerator en = atoms.first();
+	bm::bvector<>::enumerator en_end = atoms.end();
+	while (en < en_end){
+		const OrdinaryAtom& oatom = reg.ogatoms.getByAddress(*en);
+
+		// add c to the output
+		tuples.push_back(Tuple(oatom.tuple.begin() + 1, oatom.tuple.end()));
+		en++;
+	}
+}
+
+// ============================== Class InputTranslator ==============================
+
+namespace{
+	// entries of the translation table
+	const IDAddress notTranslated = ~IDAddress(0);
+	const IDAddress auxiliaryInput = ~IDAddress(0) - 1;
+}
+
+ID InputTranslator::translateAtom(RegistryPtr reg, ID emptyID, IDAddress adr){
+
+	if (translationTable.size() <= adr) translationTable.resize(adr + 1, notTranslated);
+	if (translationTable[adr] == auxiliaryInput) return ID_FAIL;
+	if (translationTable[adr] != notTranslated) return reg->ogatoms.getIDByAddress(translationTable[adr]);
+
+	// do not translate auxiliary input!
+	if (reg->ogatoms.getIDByAddress(adr).isExternalInputAuxiliary()){
+		translationTable[adr] = auxiliaryInput;
+		return ID_FAIL;
+	}
+
+	OrdinaryAtom oatom = reg->ogatoms.getByAddress(adr);
+	// check if input is valid
+	if (oatom.tuple.size() < 2) throw PluginError("Input to nested HEX programs must be of arity >= 2");
+	if (!oatom.tuple[2].isTerm() || !oatom.tuple[2].isIntegerTerm()) throw PluginError("Input to nested HEX programs must contain the arity of the mapped predicate at its second position");
+	if (oatom.tuple.size() < oatom.tuple[2].address + 3) throw PluginError("Input to nested HEX programs has an arity smaller than the specified one + 2");
+	for (int ir = 2 + oatom.tuple[2].address + 1; ir < oatom.tuple.size(); ++ir){
+		if (oatom.tuple[ir] != emptyID) throw PluginError("Input to nested HEX programs must have constant empty on all attribute positions greater than the arity of the mapped predicate");
+	}
+
+	// delete all empty elements, the 2-th and the 0-nd element
+	int arity = oatom.tuple[2].address;
+	oatom.tuple.erase(oatom.tuple.begin() + 2 + oatom.tuple[2].address + 1, oatom.tuple.end());
+	oatom.tuple.erase(oatom.tuple.begin() + 2, oatom.tuple.begin() + 3);
+	oatom.tuple.erase(oatom.tuple.begin());
+	oatom.kind = ID::MAINKIND_ATOM | ID::SUBKIND_ATOM_ORDINARYG;
+	ID inputAtom = reg->storeOrdinaryAtom(oatom);
+#ifndef NDEBUG
+	std::string outstr = "Translated " + RawPrinter::toString(reg, reg->ogatoms.getIDByAddress(adr)) + " to " + RawPrinter::toString(reg, inputAtom);
+	DBGLOG(DBG, outstr);
+#endif
+	assert(reg->ogatoms.getByID(inputAtom).tuple.size() == arity + 1 && "Translation of input atom failed");
+
+	// storing the atom might have extended the atom table
+	if (translationTable.size() <= adr) translationTable.resize(adr + 1, notTranslated);
+	translationTable[adr] = inputAtom.address;
+	return inputAtom;
+}
+
+InterpretationPtr InputTranslator::translate(RegistryPtr reg, ID emptyID, InterpretationConstPtr input, InputFingerprint& fingerprint){
+
+	if (!input) return InterpretationPtr(new Interpretation(reg));
+	DBGLOG(DBG, "Translating interpretation: " << *input);
+
+	boost::mutex::scoped_lock lock(mutex);
+
+	// successive calls usually differ only in few input atoms, thus only the difference to the previous input is translated;
+	// the result is a new interpretation since the previous one is part of a cache key
+	if (!previousHigherOrderInput){
+		previousHigherOrderInput = InterpretationPtr(new Interpretation(reg));
+		previousInput = InterpretationPtr(new Interpretation(reg));
+	}
+	if (input->getStorage() == previousHigherOrderInput->getStorage()){
+		DBGLOG(DBG, "Input is unchanged");
+		fingerprint = previousFingerprint;
+		return previousInput;
+	}
+
+	DBGLOG(DBG, "Translating input to nested hex program");
+	InterpretationPtr edb(new Interpretation(reg));
+	edb->add(*previousInput);
+	fingerprint = previousFingerprint;
+
+	// removed atoms first, as two higher-order atoms over different input predicates might encode the same atom
+	bm::bvector<> removed = previousHigherOrderInput->getStorage();
+	removed -= input->getStorage();
+	bm::bvector<>::enumerator en = removed.first();
+	bm::bvector<>::enumerator en_end = removed.end();
+	while (en < en_end){
+		ID inputAtom = translateAtom(reg, emptyID, *en);
+		if (inputAtom != ID_FAIL){
+			edb->clearFact(inputAtom.address);
+			fingerprint.remove(inputAtom.address);
+		}
+		en++;
+	}
+	bm::bvector<> added = input->getStorage();
+	added -= previousHigherOrderInput->getStorage();
+	en = added.first();
+	en_end = added.end();
+	while (en < en_end){
+		ID inputAtom = translateAtom(reg, emptyID, *en);
+		if (inputAtom != ID_FAIL && !edb->getFact(inputAtom.address)){
+			edb->setFact(inputAtom.address);
+			fingerprint.add(inputAtom.address);
+		}
+		en++;
+	}
+
+	previousHigherOrderInput = InterpretationPtr(new Interpretation(reg));
+	previousHigherOrderInput->add(*input);
+	previousInput = edb;
+	previousFingerprint = fingerprint;
+	return edb;
+}
+
+}
+
+DLVHEX_NAMESPACE_END
+
+/* vim: set noet sw=2 ts=2 tw=80: */
+
+// Local Variables:
+// mode: C++
+// End:
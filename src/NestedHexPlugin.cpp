@@ -43,6 +43,8 @@
 #include "dlvhex2/Printhelpers.h"
 #include "dlvhex2/Logger.h"
 #include "dlvhex2/ExternalLearningHelper.h"
+#include "dlvhex2/HexParser.h"
+#include "dlvhex2/PluginContainer.h"
 
 #include <iostream>
 #include <string>
@@ -52,16 +54,19 @@
 #include "boost/range.hpp"
 #include "boost/foreach.hpp"
 #include "boost/filesystem.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
 
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread.hpp>
 
 DLVHEX_NAMESPACE_BEGIN
 
 namespace nestedhex{
 
 #ifndef NDEBUG
-	#define CheckPredefinedIDs ((fileID != ID_FAIL && stringID != ID_FAIL && programID != ID_FAIL && answersetID != ID_FAIL && atomID != ID_FAIL && emptyID != ID_FAIL))
+	#define CheckPredefinedIDs ((fileID != ID_FAIL && stringID != ID_FAIL && programID != ID_FAIL && answersetID != ID_FAIL && atomID != ID_FAIL && predicateID != ID_FAIL && frequencyID != ID_FAIL && emptyID != ID_FAIL))
 #endif
 
 dlvhex::nestedhex::NestedHexPlugin theNestedHexPlugin;
@@ -87,58 +92,628 @@ void NestedHexPlugin::prepareIDs(){
 	programID = reg->storeConstantTerm("program");
 	answersetID = reg->storeConstantTerm("answerset");
 	atomID = reg->storeConstantTerm("atom");
+	predicateID = reg->storeConstantTerm("predicate");
+	frequencyID = reg->storeConstantTerm("frequency");
 	emptyID = reg->storeConstantTerm("empty");
+	hexCautiousID = reg->storeConstantTerm("hexCautious");
+	hexBraveID = reg->storeConstantTerm("hexBrave");
+	hexInspectionID = reg->storeConstantTerm("hexInspection");
 }
 
-const NestedHexPlugin::HexAnswer& NestedHexPlugin::getHexAnswer(ProgramCtx& ctx, ID type, ID program, InterpretationPtr input){
+SubprogramPtr NestedHexPlugin::getSubprogram(ProgramCtx& ctx, ID type, ID program){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	std::pair<ID, ID> key(type, program);
+	SubprogramPtr staleSubprogram;
+	CtxData::SubprogramMap::iterator it = ctxdata.subprograms.find(key);
+	if (it != ctxdata.subprograms.end()){
+		if (!it->second.isStale()) return it->second.subprogram;
+
+		DBGLOG(DBG, "Subprogram file " << it->second.filename << " has changed");
+		staleSubprogram = it->second.subprogram;
+		ctxdata.subprograms.erase(it);
+	}
+
+	// read the source code of the subprogram
+	SubprogramReference ref;
+	std::string source;
+	if (type == fileID){
+		ref.filename = reg->terms.getByID(program).getUnquotedString();
+		source = SubprogramReference::readFile(ref.filename, ref.modificationTime, ref.fileSize);
+		ref.lastCheck = std::time(0);
+	}else if (type == stringID){
+		source = reg->terms.getByID(program).getUnquotedString();
+	}else{
+		throw PluginError("Subprograms must be of type \"file\" or \"string\"");
+	}
+
+	// textually equivalent subprograms share one instance
+	std::string normalizedSource = Subprogram::normalize(source);
+	std::size_t hash = boost::hash<std::string>()(normalizedSource);
+	std::pair<CtxData::SubprogramIndex::iterator, CtxData::SubprogramIndex::iterator> candidates = ctxdata.subprogramsByContent.equal_range(hash);
+	for (CtxData::SubprogramIndex::iterator cit = candidates.first; cit != candidates.second; ++cit){
+		if (cit->second->normalizedSource == normalizedSource){
+			DBGLOG(DBG, "Subprogram " << RawPrinter::toString(reg, program) << " is equivalent to a previously parsed one");
+			ref.subprogram = cit->second;
+			break;
+		}
+	}
+
+	bool parsed = false;
+	if (!ref.subprogram){
+		ref.subprogram = parseSubprogram(ctx, source, type == fileID ? ref.filename : "subprogram");
+		ref.subprogram->name = (type == fileID ? ref.filename : normalizedSource.substr(0, 40) + (normalizedSource.length() > 40 ? "..." : ""));
+		ref.subprogram->normalizedSource = normalizedSource;
+		ref.subprogram->hash = hash;
+		ctxdata.subprogramsByContent.insert(CtxData::SubprogramIndex::value_type(hash, ref.subprogram));
+		if (!!ctxdata.statistics) ctxdata.statistics->addSubprogram(ref.subprogram);
+		parsed = true;
+	}
+	ctxdata.subprograms[key] = ref;
+
+	// answers for the previous version of a changed file are dropped
+	if (!!staleSubprogram && staleSubprogram != ref.subprogram) releaseSubprogram(ctx, staleSubprogram);
+
+	// the subprogram might contain further nested calls
+	// (it is already in the map at this point, thus a subprogram which calls itself terminates)
+	if (parsed) precompileSubprograms(ctx, ref.subprogram->idb, ref.subprogram);
+
+	return ref.subprogram;
+}
+
+SubprogramPtr NestedHexPlugin::parseSubprogram(ProgramCtx& ctx, const std::string& source, const std::string& name){
+
+	DBGLOG(DBG, "Parsing subprogram " << name);
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+	InputProviderPtr ip(new InputProvider());
+	ip->addStringInput(source, name);
+
+	// parse it into a separate context which shares the registry and the plugins with the outer program
+	ProgramCtx pc = ctx;
+	pc.idb.clear();
+	pc.edb = InterpretationPtr(new Interpretation(reg));
+	ModuleHexParserPtr parser(new ModuleHexParser());
+	BOOST_FOREACH (PluginInterfacePtr plugin, ctx.pluginContainer()->getPlugins()){
+		BOOST_FOREACH (HexParserModulePtr module, plugin->createParserModules(pc)){
+			parser->registerModule(module);
+		}
+	}
+	try{
+		parser->parse(ip, pc);
+	}catch(const std::exception& e){
+		throw PluginError("Error while parsing subprogram " + name + ": " + e.what());
+	}
+
+	SubprogramPtr subprogram(new Subprogram());
+	subprogram->idb = pc.idb;
+	subprogram->edb = pc.edb;
+	subprogram->analyze(reg);
+	DBGLOG(DBG, "Subprogram " << name << " is " << (subprogram->monotone ? "" : "not ") << "monotone");
+
+	subprogram->statistics.parseTime = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1000000.0;
+
+	// the evaluation context is set up once for all inputs, only the EDB is filled per evaluation
+	subprogram->pc = pc;
+	subprogram->pc.edb = InterpretationPtr(new Interpretation(reg));
+	subprogram->pc.currentOptimum.clear();
+	subprogram->pc.config.setOption("NumberOfModels", 0);
+	subprogram->pc.inputProvider = InputProviderPtr(new InputProvider());	// nothing left to parse
+	return subprogram;
+}
+
+void NestedHexPlugin::releaseSubprogram(ProgramCtx& ctx, SubprogramPtr subprogram){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	BOOST_FOREACH (const CtxData::SubprogramMap::value_type& ref, ctxdata.subprograms){
+		if (ref.second.subprogram == subprogram) return;
+	}
+
+	DBGLOG(DBG, "Releasing subprogram and its cached answers");
+	std::pair<CtxData::SubprogramIndex::iterator, CtxData::SubprogramIndex::iterator> range = ctxdata.subprogramsByContent.equal_range(subprogram->hash);
+	for (CtxData::SubprogramIndex::iterator it = range.first; it != range.second; ++it){
+		if (it->second == subprogram){
+			ctxdata.subprogramsByContent.erase(it);
+			break;
+		}
+	}
+	ctxdata.cache.remove(subprogram);
+	BOOST_FOREACH (const Subprogram::SliceMap::value_type& slice, subprogram->slices){
+		if (!!slice.second) ctxdata.cache.remove(slice.second);
+	}
+}
+
+void NestedHexPlugin::precompileSubprograms(ProgramCtx& ctx, const std::vector<ID>& idb, SubprogramPtr caller){
+
+	BOOST_FOREACH (ID ruleID, idb){
+		const Rule& rule = reg->rules.getByID(ruleID);
+		BOOST_FOREACH (ID lit, rule.body){
+			if (!lit.isExternalAtom()) continue;
+			const ExternalAtom& eatom = reg->eatoms.getByID(lit);
+			if (eatom.predicate != hexCautiousID && eatom.predicate != hexBraveID && eatom.predicate != hexInspectionID) continue;
+
+			// only subprograms which are known before evaluation can be parsed in advance
+			if (eatom.inputs.size() >= 2 && (eatom.inputs[0] == fileID || eatom.inputs[0] == stringID) && eatom.inputs[1].isConstantTerm()){
+				SubprogramPtr subprogram = getSubprogram(ctx, eatom.inputs[0], eatom.inputs[1]);
+				if (eatom.predicate == hexInspectionID) subprogram->inspected = true;
+				else declareSupportSets(ctx, eatom, subprogram);
+				if (!!caller) caller->calledSubprograms.push_back(subprogram);
+			}else if (!!caller){
+				caller->hasDynamicCalls = true;
+			}
+		}
+	}
+}
+
+SupportSetTemplatesPtr NestedHexPlugin::getSupportSetTemplates(ProgramCtx& ctx, SubprogramPtr subprogram, ID queryPredicate, const std::set<ID>& inputPredicates){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	SupportSetTemplatesPtr& templates = subprogram->supportSetTemplates[std::pair<ID, std::set<ID> >(queryPredicate, inputPredicates)];
+	if (!templates){
+		SupportSetGenerator generator(reg, *subprogram, ctxdata.supportSetMaxSize, ctxdata.supportSetMaxTime);
+		templates = generator.generate(queryPredicate, inputPredicates);
+	}
+	return templates;
+}
+
+SubprogramPtr NestedHexPlugin::getSlice(ProgramCtx& ctx, SubprogramPtr subprogram, ID queryPredicate){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	Subprogram::SliceMap::iterator it = subprogram->slices.find(queryPredicate);
+	if (it == subprogram->slices.end()){
+		SubprogramPtr slice = subprogram->slice(reg, queryPredicate);
+		if (!!slice && !!ctxdata.statistics) ctxdata.statistics->addSubprogram(slice);
+		it = subprogram->slices.insert(Subprogram::SliceMap::value_type(queryPredicate, slice)).first;
+	}
+	return (!!it->second ? it->second : subprogram);
+}
+
+InterpretationPtr NestedHexPlugin::projectInput(ProgramCtx& ctx, SubprogramPtr subprogram, ID queryPredicate, InterpretationPtr input, InputFingerprint& fingerprint){
+
+	if (!subprogram->readPredicatesKnown) return input;
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	PredicateMaskPtr& pm = subprogram->inputMasks[queryPredicate];
+	if (!pm){
+		pm = PredicateMaskPtr(new PredicateMask());
+		pm->setRegistry(reg);
+		BOOST_FOREACH (ID pred, subprogram->readPredicates) pm->addPredicate(pred);
+		pm->addPredicate(queryPredicate);
+	}
+	pm->updateMask();
+
+	bm::bvector<> dropped = input->getStorage();
+	dropped -= pm->mask()->getStorage();
+	if (!dropped.any()) return input;
+
+	DBGLOG(DBG, "Dropping " << dropped.count() << " irrelevant input facts");
+	bm::bvector<>::enumerator en = dropped.first();
+	bm::bvector<>::enumerator en_end = dropped.end();
+	while (en < en_end){
+		fingerprint.remove(*en);
+		en++;
+	}
+	InterpretationPtr projected(new Interpretation(reg));
+	projected->add(*input);
+	projected->getStorage() -= dropped;
+	return projected;
+}
+
+PredicateMaskPtr NestedHexPlugin::getQueryMask(ProgramCtx& ctx, ID predicate){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	PredicateMaskPtr& pm = ctxdata.queryMasks[predicate];
+	if (!pm){
+		pm = PredicateMaskPtr(new PredicateMask());
+		pm->setRegistry(reg);
+		pm->addPredicate(predicate);
+	}
+	return pm;
+}
+
+void NestedHexPlugin::declareSupportSets(ProgramCtx& ctx, const ExternalAtom& eatom, SubprogramPtr subprogram){
+
+	if (!ctx.config.getOption("SupportSets")) return;
+	if (eatom.prop.supportSets && eatom.prop.completePositiveSupportSets) return;
+
+	// a definite subprogram without constraints has exactly one answer set, which contains q(c) iff q(c) is derived from the input;
+	// thus cautious and brave queries coincide and the support sets are complete if all derivations are known
+	// (the templates cover the facts and rules of the subprogram, input atoms over q are covered by NestedHexPluginAtom::learnSupportSets);
+	// with recursive predicates, derivations are unbounded, thus the support sets are not declared to be complete
+	if (!subprogram->monotone || subprogram->hasConstraints || eatom.inputs.size() != 4 || !eatom.inputs[3].isConstantTerm()) return;
+	SupportSetTemplatesPtr templates = getSupportSetTemplates(ctx, subprogram, eatom.inputs[3], subprogram->bodyPredicates);
+	if (!templates->complete || templates->recursive) return;
+
+	DBGLOG(DBG, "Declaring complete positive support sets for " << RawPrinter::toString(reg, eatom.predicate) << " over subprogram " << RawPrinter::toString(reg, eatom.inputs[1]));
+	ExternalAtom declared = eatom;
+	declared.prop.supportSets = true;
+	declared.prop.completePositiveSupportSets = true;
+	reg->eatoms.update(eatom, declared);
+}
+
+HexAnswerPtr NestedHexPlugin::getHexAnswer(ProgramCtx& ctx, ID type, ID program, ID queryPredicate, InterpretationPtr input, const InputFingerprint& inputFingerprint){
 
 	assert(CheckPredefinedIDs && "IDs have not been initialized");
 	assert(!!input && "invalid input interpretation");
 
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+
+	// subprograms are identified by their content rather than by the program parameter;
+	// cautious and brave queries only need the part of the subprogram which is relevant for the query predicate
+	SubprogramPtr subprogram = getSubprogram(ctx, type, program);
+	if (queryPredicate != ID_FAIL) subprogram = getSlice(ctx, subprogram, queryPredicate);
+
+	// the cache key only contains the input facts which are relevant for the query
+	// (inspection queries return the whole answer sets, which contain all input facts)
+	InputFingerprint fingerprint = inputFingerprint;
+	if (queryPredicate != ID_FAIL) input = projectInput(ctx, subprogram, queryPredicate, input, fingerprint);
+	subprogram->statistics.calls++;
+
 	DBGLOG(DBG, "Checking if answer is in cache");
-	int cacheSize = ctx.getPluginData<NestedHexPlugin>().cache.size();
-	for (int i = 0; i < cacheSize; ++i){
-		HexAnswer& answer = ctx.getPluginData<NestedHexPlugin>().cache[i];
-		assert(!!answer.input && "Invalid cache entry");
-		if ((answer.type == type) && (answer.program == program) && (answer.input->getStorage() == input->getStorage())){
-			DBGLOG(DBG, "Retrieving answer sets from cache");
-			return answer;
-		}
+	HexAnswerPtr cached = ctxdata.cache.find(subprogram, input, fingerprint);
+	if (!!cached){
+		DBGLOG(DBG, "Retrieving answer sets from cache");
+		subprogram->statistics.hits++;
+		return cached;
 	}
 
 	DBGLOG(DBG, "Answer was not found in cache");
+	subprogram->statistics.misses++;
+
+	HexAnswerPtr answer(new HexAnswer());
+	answer->type = type;
+	answer->program = program;
+	answer->subprogram = subprogram;
+	answer->input = input;
+	answer->inputFingerprint = fingerprint.getValue();
+
+	// for monotone subprograms, answers for smaller and larger inputs bound the new one
+	if (subprogram->monotone){
+		HexAnswerPtr lower, upper;
+		ctxdata.cache.findBounds(subprogram, input, lower, upper);
+		if (!!lower && lower->answersets.size() == 0){
+			DBGLOG(DBG, "Subprogram is inconsistent for a subset of the input");
+			answer->consistent = false;
+			answer->answersetsComputed = true;
+			answer->answersetCount = 0;
+		}else if (!!upper){
+			// the answer set lies between the one for the subset (plus the facts) and the one for the superset;
+			// if both coincide, it is determined
+			bm::bvector<> undetermined = upper->answersets[0]->getStorage();
+			undetermined -= subprogram->edb->getStorage();
+			undetermined -= input->getStorage();
+			if (!!lower) undetermined -= lower->answersets[0]->getStorage();
+			if (!undetermined.any()){
+				DBGLOG(DBG, "Answer set is determined by the answers for a subset and a superset of the input");
+				answer->answersets.push_back(upper->answersets[0]);
+				answer->answersetsComputed = true;
+			}
+			answer->consistent = true;
+			answer->answersetCount = 1;
+		}
+		if (!answer->answersetsComputed && !!lower) answer->lowerBound = lower->answersets[0];
+	}
 
-	// read the subprogram from the file
-	InputProviderPtr ip(new InputProvider());
-	if (type == fileID) ip->addFileInput(ctx.registry()->terms.getByID(program).getUnquotedString());
-	else if (type == stringID) ip->addStringInput(ctx.registry()->terms.getByID(program).getUnquotedString(), "subprogram");
-	else { assert(false && "invalid call type"); }
-
-	// not in cache --> add it
-	ctx.getPluginData<NestedHexPlugin>().cache.push_back(HexAnswer());
-	HexAnswer& answer = ctx.getPluginData<NestedHexPlugin>().cache[ctx.getPluginData<NestedHexPlugin>().cache.size() - 1];
-	answer.type = type;
-	answer.program = program;
-	answer.input = input;
-
-	// prepare data structures for the subprogram P
-	answer.pc = ctx;
-	answer.pc.idb.clear();
-	answer.pc.edb = input;
-	answer.pc.currentOptimum.clear();
-	answer.pc.config.setOption("NumberOfModels",0);
-	answer.pc.inputProvider = ip;
-	ip.reset();
-
-	// compute all answer sets of P \cup F
+	// answers from previous runs are reused
+	if (!answer->answersetsComputed && !!ctxdata.persistentCache && ctxdata.persistentCache->load(reg, answer)){
+		DBGLOG(DBG, "Retrieved answer from cache directory");
+	}
+
+	// the answer is evaluated lazily by the caller
+	ctxdata.cache.insert(answer);
+
+	return answer;
+}
+
+std::vector<InterpretationPtr> NestedHexPlugin::evaluateSubprogram(ProgramCtx& ctx, HexAnswerPtr answer, const std::vector<ID>& additionalRules, int maxModels){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	std::vector<InterpretationPtr> answersets;
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
 	try{
-		DBGLOG(DBG, "Evaluating subprogram under " << *input);
-		answer.answersets = ctx.evaluateSubprogram(answer.pc, true);
+		DBGLOG(DBG, "Evaluating subprogram under " << *answer->input << " with " << additionalRules.size() << " additional rules");
+		if (ctxdata.incremental && answer->subprogram->ordinary && additionalRules.size() == 0){
+			// the ground program and the solver of the subprogram are reused, the input is selected by assumptions
+			// (answers for smaller inputs of monotone subprograms are not needed then);
+			// ordinary subprograms do not contain nested calls, thus the lock can be held during evaluation
+			boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+			if (!answer->subprogram->solver) answer->subprogram->solver = IncrementalSolverPtr(new IncrementalSolver(answer->subprogram->pc, answer->subprogram->idb, answer->subprogram->edb));
+			answersets = answer->subprogram->solver->evaluate(answer->input, maxModels);
+		}else{
+			// evaluation modifies the context, thus we work on a copy of the one prepared for the subprogram;
+			// the EDB consists of the facts of P and the input F (the input itself must remain unchanged as it is part of the cache key)
+			ProgramCtx pc = answer->subprogram->pc;
+			pc.idb.insert(pc.idb.end(), additionalRules.begin(), additionalRules.end());
+			pc.edb = InterpretationPtr(new Interpretation(reg));
+			pc.edb->add(*answer->subprogram->edb);
+			pc.edb->add(*answer->input);
+			if (!!answer->lowerBound) pc.edb->add(*answer->lowerBound);
+			pc.config.setOption("NumberOfModels", maxModels);
+			pc.inputProvider = InputProviderPtr(new InputProvider());
+			answersets = ctx.evaluateSubprogram(pc, true);
+		}
+	}catch(const std::exception& e){
+		throw PluginError("Error during evaluation of subprogram " + RawPrinter::toString(reg, answer->program) + ": " + e.what());
 	}catch(...){
-		throw PluginError("Error during evaluation of subprogram " + RawPrinter::toString(reg, answer.program));
-	}	
+		throw PluginError("Error during evaluation of subprogram " + RawPrinter::toString(reg, answer->program));
+	}
+	double time = (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1000000.0;
+
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	answer->evaluationTime += time;
+	answer->subprogram->statistics.evaluations++;
+	answer->subprogram->statistics.models += answersets.size();
+	answer->subprogram->statistics.evaluationTime += time;
+	return answersets;
+}
 
-	return answer;
+void NestedHexPlugin::computeAnswerSets(ProgramCtx& ctx, HexAnswerPtr answer, std::size_t minCount){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	if (answer->answersetsComputed || (minCount > 0 && answer->answersets.size() >= minCount)) return;
+
+	// with weak constraints, blocking constraints would change the optimal models, thus the enumeration cannot be resumed
+	bool resumable = !answer->subprogram->hasWeakConstraints;
+	assert((resumable || answer->answersets.size() == 0) && "enumeration of answer sets cannot be resumed");
+
+	int maxModels = 0;
+	if (minCount > 0 && resumable){
+		// at least double the number of known answer sets such that the number of solver calls stays logarithmic
+		maxModels = std::max(minCount - answer->answersets.size(), answer->answersets.size());
+	}
+
+	// compute (further) answer sets of P \cup F which are different from the known ones
+	// the lock is not held during evaluation since nested calls might need it
+	DBGLOG(DBG, "Computing " << (maxModels == 0 ? std::string("all") : boost::lexical_cast<std::string>(maxModels)) << " further answer sets");
+	std::size_t known = answer->answersets.size();
+	std::vector<ID> blockingConstraints = answer->blockingConstraints;
+	lock.unlock();
+	std::vector<InterpretationPtr> answersets = evaluateSubprogram(ctx, answer, blockingConstraints, maxModels);
+	lock.lock();
+
+	// another thread might have extended the answer in the meantime, then our result is outdated
+	if (answer->answersets.size() != known || answer->answersetsComputed){
+		lock.unlock();
+		computeAnswerSets(ctx, answer, minCount);
+		return;
+	}
+	BOOST_FOREACH (InterpretationPtr as, answersets){
+		answer->answersets.push_back(as);
+		if (resumable) answer->blockingConstraints.push_back(storeBlockingConstraint(answer, as));
+	}
+	if (maxModels == 0 || answersets.size() < maxModels){
+		answer->answersetsComputed = true;
+		answer->answersetCount = answer->answersets.size();
+	}
+	answer->consistent = (answer->answersets.size() > 0);
+	ctxdata.cache.update(answer);
+	if (answer->subprogram->inspected) listAnswerSetAtoms(ctx, answer);
+	if (answer->answersetsComputed && !!ctxdata.persistentCache) ctxdata.persistentCache->store(reg, answer);
+}
+
+void NestedHexPlugin::listAnswerSetAtoms(ProgramCtx& ctx, HexAnswerPtr answer){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	if (answer->answersetAtoms.size() == answer->answersets.size()) return;
+
+	while (answer->answersetAtoms.size() < answer->answersets.size()){
+		InterpretationConstPtr answerset = answer->answersets[answer->answersetAtoms.size()];
+		std::vector<Tuple>* atoms = new std::vector<Tuple>();
+		HexAnswer::OutputTuplesPtr atomsPtr(atoms);
+		bm::bvector<>::enumerator en = answerset->getStorage().first();
+		bm::bvector<>::enumerator en_end = answerset->getStorage().end();
+		while (en < en_end){
+			// do not output auxiliary atoms
+			if (!reg->ogatoms.getIDByAddress(*en).isAuxiliary()){
+				Tuple t(2);
+				t[0] = ID::termFromInteger(*en);
+				t[1] = ID::termFromInteger(reg->ogatoms.getByAddress(*en).tuple.size() - 1);
+				atoms->push_back(t);
+			}
+			en++;
+		}
+		answer->answersetAtoms.push_back(atomsPtr);
+	}
+	ctxdata.cache.update(answer);
+}
+
+int NestedHexPlugin::getReductionThreads(ProgramCtx& ctx, std::size_t answersetCount){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	if (ctxdata.reductionThreshold == 0 || answersetCount < ctxdata.reductionThreshold) return 1;
+
+	// all cores
+	return std::max(1u, boost::thread::hardware_concurrency());
+}
+
+void NestedHexPlugin::summarizeAnswerSets(ProgramCtx& ctx, HexAnswerPtr answer){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	if (!!answer->answersetIntersection) return;
+
+	// the answer sets are only held until they have been folded into the intersection and the union
+	std::vector<InterpretationPtr> answersets = answer->answersets;
+	if (!answer->answersetsComputed){
+		DBGLOG(DBG, "Computing intersection and union of all answer sets");
+		std::size_t known = answer->answersets.size();
+		std::vector<ID> blockingConstraints = answer->blockingConstraints;
+		lock.unlock();
+		std::vector<InterpretationPtr> further = evaluateSubprogram(ctx, answer, blockingConstraints, 0);
+		lock.lock();
+
+		// another thread might have extended the answer in the meantime, then our result is outdated
+		if (!!answer->answersetIntersection) return;
+		if (answer->answersets.size() != known || answer->answersetsComputed){
+			lock.unlock();
+			summarizeAnswerSets(ctx, answer);
+			return;
+		}
+		answersets.insert(answersets.end(), further.begin(), further.end());
+	}
+
+	InterpretationPtr intersection(new Interpretation(reg));
+	InterpretationPtr unification(new Interpretation(reg));
+	nestedhex::summarizeAnswerSets(answersets, intersection->getStorage(), unification->getStorage(), getReductionThreads(ctx, answersets.size()));
+	answer->answersetIntersection = intersection;
+	answer->answersetUnion = unification;
+	answer->answersetCount = answersets.size();
+	answer->consistent = (answersets.size() > 0);
+
+	// the answer sets are not needed anymore (they are computed again from scratch if they are inspected after all)
+	answer->answersets.clear();
+	answer->blockingConstraints.clear();
+	answer->answersetAtoms.clear();
+	answer->answersetsComputed = false;
+	ctxdata.cache.update(answer);
+	if (!!ctxdata.persistentCache) ctxdata.persistentCache->store(reg, answer);
+}
+
+std::size_t NestedHexPlugin::getAnswerSetCount(ProgramCtx& ctx, HexAnswerPtr answer){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	if (answer->answersetCount < 0){
+		DBGLOG(DBG, "Counting answer sets");
+		std::size_t known = answer->answersets.size();
+		std::vector<ID> blockingConstraints = answer->blockingConstraints;
+		lock.unlock();
+		std::size_t count = evaluateSubprogram(ctx, answer, blockingConstraints, 0).size() + known;
+		lock.lock();
+		answer->answersetCount = count;
+		answer->consistent = (count > 0);
+	}
+	return answer->answersetCount;
+}
+
+ID NestedHexPlugin::storeConstraint(InterpretationConstPtr atoms, bool negated){
+
+	Rule constraint(ID::MAINKIND_RULE | ID::SUBKIND_RULE_CONSTRAINT);
+	bm::bvector<>::enumerator en = atoms->getStorage().first();
+	bm::bvector<>::enumerator en_end = atoms->getStorage().end();
+	while (en < en_end){
+		ID atomID = reg->ogatoms.getIDByAddress(*en);
+		constraint.body.push_back(negated ? ID::nafLiteralFromAtom(atomID) : ID::posLiteralFromAtom(atomID));
+		en++;
+	}
+	return reg->storeRule(constraint);
+}
+
+ID NestedHexPlugin::storeBlockingConstraint(HexAnswerPtr answer, InterpretationConstPtr answerset){
+
+	// since answer sets are subset-minimal, the constraint :- a1, ..., an over the atoms of an answer set eliminates only this one;
+	// the input facts are true in all answer sets and auxiliary atoms are not part of the subprogram, thus both are left out
+	InterpretationPtr atoms(new Interpretation(reg));
+	atoms->add(*answerset);
+	atoms->getStorage() -= answer->subprogram->edb->getStorage();
+	atoms->getStorage() -= answer->input->getStorage();
+	bm::bvector<>::enumerator en = answerset->getStorage().first();
+	bm::bvector<>::enumerator en_end = answerset->getStorage().end();
+	while (en < en_end){
+		if (reg->ogatoms.getIDByAddress(*en).isAuxiliary()) atoms->clearFact(*en);
+		en++;
+	}
+	return storeConstraint(atoms, false);
+}
+
+InterpretationConstPtr NestedHexPlugin::getCautiousConsequences(ProgramCtx& ctx, HexAnswerPtr answer, ID predicate, PredicateMaskPtr pm){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	{
+		boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+		std::map<ID, InterpretationPtr>::const_iterator it = answer->cautiousConsequences.find(predicate);
+		if (it != answer->cautiousConsequences.end()) return it->second;
+	}
+
+	assert(!answer->subprogram->hasWeakConstraints && "cautious consequences cannot be computed by adding constraints if the subprogram has weak constraints");
+	DBGLOG(DBG, "Computing cautious consequences iteratively");
+
+	// the candidates are the atoms over the query predicate in an arbitrary answer set
+	InterpretationPtr candidates(new Interpretation(reg));
+	std::vector<InterpretationPtr> answersets = evaluateSubprogram(ctx, answer, std::vector<ID>(), 1);
+	bool consistent = (answersets.size() > 0);
+	if (consistent){
+		pm->updateMask();
+		candidates->add(*pm->mask());
+		candidates->getStorage() &= answersets[0]->getStorage();
+	}
+
+	// as long as there are candidates left, search for an answer set which falsifies at least one of them,
+	// i.e., add the constraint :- c1, ..., cn for the remaining candidates c1, ..., cn;
+	// each answer set eliminates at least one candidate, thus there are at most n+1 solver calls
+	while (candidates->getStorage().any()){
+		std::vector<ID> additionalRules;
+		additionalRules.push_back(storeConstraint(candidates, false));
+
+		answersets = evaluateSubprogram(ctx, answer, additionalRules, 1);
+		if (answersets.size() == 0) break;
+		candidates->getStorage() &= answersets[0]->getStorage();
+	}
+	DBGLOG(DBG, "Cautious consequences: " << *candidates);
+
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	answer->consistent = consistent;
+	answer->cautiousConsequences[predicate] = candidates;
+	ctxdata.cache.update(answer);
+	if (!!ctxdata.persistentCache) ctxdata.persistentCache->store(reg, answer);
+	return candidates;
+}
+
+InterpretationConstPtr NestedHexPlugin::getBraveConsequences(ProgramCtx& ctx, HexAnswerPtr answer, ID predicate, PredicateMaskPtr pm){
+
+	CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+	{
+		boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+		std::map<ID, InterpretationPtr>::const_iterator it = answer->braveConsequences.find(predicate);
+		if (it != answer->braveConsequences.end()) return it->second;
+	}
+
+	assert(!answer->subprogram->hasWeakConstraints && "brave consequences cannot be computed by adding constraints if the subprogram has weak constraints");
+	DBGLOG(DBG, "Computing brave consequences iteratively");
+
+	// start with the atoms over the query predicate in an arbitrary answer set
+	InterpretationPtr consequences(new Interpretation(reg));
+	InterpretationPtr unseen(new Interpretation(reg));
+	std::vector<InterpretationPtr> answersets = evaluateSubprogram(ctx, answer, std::vector<ID>(), 1);
+	bool consistent = (answersets.size() > 0);
+	if (consistent){
+		pm->updateMask();
+		consequences->add(*pm->mask());
+		consequences->getStorage() &= answersets[0]->getStorage();
+		unseen->add(*pm->mask());
+		unseen->getStorage() -= consequences->getStorage();
+	}
+
+	// as long as the mask is not saturated, search for an answer set which contains at least one atom which was not seen before,
+	// i.e., add the constraint :- not u1, ..., not un for the unseen atoms u1, ..., un;
+	// each answer set adds at least one brave consequence, thus the number of solver calls is bounded by their number + 1
+	while (unseen->getStorage().any()){
+		std::vector<ID> additionalRules;
+		additionalRules.push_back(storeConstraint(unseen, true));
+
+		answersets = evaluateSubprogram(ctx, answer, additionalRules, 1);
+		if (answersets.size() == 0) break;
+		bm::bvector<> newConsequences = unseen->getStorage() & answersets[0]->getStorage();
+		consequences->getStorage() |= newConsequences;
+		unseen->getStorage() -= newConsequences;
+	}
+	DBGLOG(DBG, "Brave consequences: " << *consequences);
+
+	boost::recursive_mutex::scoped_lock lock(ctxdata.mutex);
+	answer->consistent = consistent;
+	answer->braveConsequences[predicate] = consequences;
+	ctxdata.cache.update(answer);
+	if (!!ctxdata.persistentCache) ctxdata.persistentCache->store(reg, answer);
+	return consequences;
 }
 
 // Collect all types of external atoms 
@@ -151,6 +726,7 @@ NestedHexPlugin::NestedHexPlugin():
 
 NestedHexPlugin::~NestedHexPlugin()
 {
+	BOOST_FOREACH (StatisticsPtr stats, statistics) stats->report();
 }
 
 // Define two external atoms: for the roles and for the concept queries
@@ -167,10 +743,68 @@ void NestedHexPlugin::processOptions(std::list<const char*>& pluginOptions, Prog
 	std::vector<std::list<const char*>::iterator> found;
 	for(std::list<const char*>::iterator it = pluginOptions.begin(); it != pluginOptions.end(); it++){
 		std::string option(*it);
-		if (option.find("--nestedhex") != std::string::npos){
+		if (option == "--nestedhex"){
 			ctx.getPluginData<NestedHexPlugin>().rewrite = true;
 			found.push_back(it);
 		}
+		else if (option == "--nestedhex-iterative"){
+			ctx.getPluginData<NestedHexPlugin>().iterativeQueries = true;
+			found.push_back(it);
+		}
+		else if (option == "--nestedhex-incremental"){
+			ctx.getPluginData<NestedHexPlugin>().incremental = true;
+			found.push_back(it);
+		}
+		else if (boost::starts_with(option, "--nestedhex-cachedir=")){
+			std::string value = option.substr(std::string("--nestedhex-cachedir=").length());
+			if (value.empty()) throw PluginError("Invalid value for --nestedhex-cachedir: expected directory");
+			ctx.getPluginData<NestedHexPlugin>().persistentCache = PersistentCachePtr(new PersistentCache(value));
+			found.push_back(it);
+		}
+		else if (option == "--nestedhex-stats" || boost::starts_with(option, "--nestedhex-stats=")){
+			std::string filename = (option == "--nestedhex-stats" ? std::string() : option.substr(std::string("--nestedhex-stats=").length()));
+			CtxData& ctxdata = ctx.getPluginData<NestedHexPlugin>();
+			ctxdata.statistics = StatisticsPtr(new Statistics(filename));
+			ctxdata.statistics->setCache(&ctxdata.cache);
+			statistics.push_back(ctxdata.statistics);
+			found.push_back(it);
+		}
+		else if (boost::starts_with(option, "--nestedhex-supportsetsize=")){
+			std::string value = option.substr(std::string("--nestedhex-supportsetsize=").length());
+			try{
+				ctx.getPluginData<NestedHexPlugin>().supportSetMaxSize = boost::lexical_cast<std::size_t>(value);
+			}catch(const boost::bad_lexical_cast&){
+				throw PluginError("Invalid value for --nestedhex-supportsetsize: \"" + value + "\" (expected number of literals)");
+			}
+			found.push_back(it);
+		}
+		else if (boost::starts_with(option, "--nestedhex-supportsettime=")){
+			std::string value = option.substr(std::string("--nestedhex-supportsettime=").length());
+			try{
+				ctx.getPluginData<NestedHexPlugin>().supportSetMaxTime = boost::lexical_cast<double>(value);
+			}catch(const boost::bad_lexical_cast&){
+				throw PluginError("Invalid value for --nestedhex-supportsettime: \"" + value + "\" (expected time in seconds)");
+			}
+			found.push_back(it);
+		}
+		else if (boost::starts_with(option, "--nestedhex-reductionthreshold=")){
+			std::string value = option.substr(std::string("--nestedhex-reductionthreshold=").length());
+			try{
+				ctx.getPluginData<NestedHexPlugin>().reductionThreshold = boost::lexical_cast<std::size_t>(value);
+			}catch(const boost::bad_lexical_cast&){
+				throw PluginError("Invalid value for --nestedhex-reductionthreshold: \"" + value + "\" (expected number of answer sets)");
+			}
+			found.push_back(it);
+		}
+		else if (boost::starts_with(option, "--nestedhex-cachesize=")){
+			std::string value = option.substr(std::string("--nestedhex-cachesize=").length());
+			try{
+				ctx.getPluginData<NestedHexPlugin>().cache.setMemoryLimit(boost::lexical_cast<std::size_t>(value) * 1024 * 1024);
+			}catch(const boost::bad_lexical_cast&){
+				throw PluginError("Invalid value for --nestedhex-cachesize: \"" + value + "\" (expected size in MB)");
+			}
+			found.push_back(it);
+		}
 	}
 
 	for(std::vector<std::list<const char*>::iterator>::const_iterator it = found.begin(); it != found.end(); ++it){
@@ -207,6 +841,22 @@ NestedHexPlugin::createParserModules(ProgramCtx& ctx)
 
 void NestedHexPlugin::printUsage(std::ostream& o) const{
 	o << "     --nestedhex                 Activates convenient syntax for queries over nested hex programs" << std::endl <<
+	     "     --nestedhex-cachedir=<path> Stores answers of subprograms in the given directory and reuses them in later runs" << std::endl <<
+	     "     --nestedhex-cachesize=<MB>  Limits the memory used for caching answers of subprograms (default: unlimited);" << std::endl <<
+	     "                                 if the limit is exceeded, answers which are cheap to recompute relative to their size are dropped first" << std::endl <<
+	     "     --nestedhex-iterative       Answers cautious and brave queries by a sequence of solver calls which eliminate candidate atoms" << std::endl <<
+	     "                                 resp. find new consequences, instead of enumerating all answer sets of the subprogram" << std::endl <<
+	     "     --nestedhex-incremental     Grounds subprograms without external atoms, aggregates and weak constraints once over all inputs seen so far" << std::endl <<
+	     "                                 and selects the input of a call by solver assumptions, such that the solver is reused across calls" << std::endl <<
+	     "     --nestedhex-stats[=<file>]  Reports calls, cache hits, solver calls and times per subprogram at the end of the run" << std::endl <<
+	     "                                 (on stderr or as tab-separated table in the given file)" << std::endl <<
+	     "     --nestedhex-supportsetsize=<n>" << std::endl <<
+	     "                                 Maximum number of literals in support sets which are learned for subprograms (default: 10)" << std::endl <<
+	     "     --nestedhex-supportsettime=<s>" << std::endl <<
+	     "                                 Maximum time in seconds for computing the support sets of a subprogram and query (default: 1)" << std::endl <<
+	     "     --nestedhex-reductionthreshold=<n>" << std::endl <<
+	     "                                 Aggregates at least n answer sets for cautious and brave queries on several threads" << std::endl <<
+	     "                                 (on all cores; default: 10000, 0 disables)" << std::endl <<
 	     "" << std::endl <<
 	     "     The plugin supports the following external atoms:" << std::endl <<
 	     "" << std::endl <<
@@ -228,7 +878,7 @@ void NestedHexPlugin::printUsage(std::ostream& o) const{
 	     "          The external atom evaluates to true for all values x1, ..., xn" << std::endl <<
 	     "          such that q(x1, ..., xn) is cautiously/bravely true in p extended with the input from i." << std::endl <<
 	     "" << std::endl <<
-	     "     - &hexInspection[t, p, i, qt, qp](x1, x2)" << std::endl <<
+	     "     - &hexInspection[t, p, i, qt, qp](x1, ..., xn)" << std::endl <<
 	     "" << std::endl <<
 	     "          Evaluates the program p of type t extended with input from i as described above." << std::endl <<
 	     "          Parameter qp is optional." << std::endl <<
@@ -244,6 +894,15 @@ void NestedHexPlugin::printUsage(std::ostream& o) const{
 	     "          which encode the atom identified by qp. If the identified atom has arity a, then pairs (x, t)" << std::endl <<
 	     "          for 0 <= x <= a consist of encode the term t at argument position x, where x=0 denotes the predicate name." << std::endl <<
 	     "" << std::endl <<
+	     "          If qt=predicate and qp is a predicate, then the external atom is true for all tuples (x, t1, ..., tk)" << std::endl <<
+	     "          such that qp(t1, ..., tk) is true in the answer set identified by x." << std::endl <<
+	     "" << std::endl <<
+	     "          If qt=frequency and qp is a predicate, then the external atom is true for all tuples (n, t1, ..., tk)" << std::endl <<
+	     "          such that qp(t1, ..., tk) is true in exactly n > 0 answer sets." << std::endl <<
+	     "" << std::endl <<
+	     "          The latter two query types retrieve the contents of all answer sets with a single call" << std::endl <<
+	     "          instead of one call per answer set and one per atom." << std::endl <<
+	     "" << std::endl <<
 	     "     The command-line option --nestedhex activates a rewriter, which allows for using a more convenient syntax" << std::endl <<
              "          (for details see http://www.kr.tuwien.ac.at/research/systems/dlvhex/nestedhexplugin.html)" << std::endl;
 
@@ -252,12 +911,15 @@ void NestedHexPlugin::printUsage(std::ostream& o) const{
 	//	query.input[0] (i.e. "type"): either "file" or "string"
 	//	query.input[1] (i.e. "prog"): filename of the program P over which we do query answering
 	//	query.input[2] (i.e. p): a predicate name; the set F of all atoms over this predicate are added to P as facts before evaluation
-	//	query.input[3] (i.e. query type): one of "program", "answerset", "atom"
-	//	query.input[4] (optional): missing if query type is "program", an answer set index if query type is "answerset", an atom index if query type is "atom"
+	//	query.input[3] (i.e. query type): one of "program", "answerset", "atom", "predicate", "frequency"
+	//	query.input[4] (optional): missing if query type is "program", an answer set index if query type is "answerset", an atom index if query type is "atom",
+	//				   a predicate if query type is "predicate" or "frequency"
 	// output:
 	//      if query type is program: pairs (i, n) for all 0 <= i <= n, where n is the number of answer sets of the program
 	//	if query type is answerset: pairs (i, a) for alle atoms with index i in the answer set, and a is the arity of the respective atom
 	//	if query type is atom: pairs (0, p) and (i, t[i]) for all 1 <= i <= a, where p is the predicate of the atom, a is its arity and t[i] is the term at argument position i
+	//	if query type is predicate: tuples (i, t1, ..., tk) for all atoms q(t1, ..., tk) in answer set i, where q is the given predicate
+	//	if query type is frequency: tuples (n, t1, ..., tk) for all atoms q(t1, ..., tk) which are true in n > 0 answer sets, where q is the given predicate
 
 
 }
@@ -273,6 +935,25 @@ void NestedHexPlugin::setRegistry(RegistryPtr reg){
 	prepareIDs();
 }
 
+// not a rewriter in the strict sense: it parses all subprograms which are statically referenced in the outer program
+// such that they do not need to be parsed during evaluation and syntax errors are reported before evaluation starts
+class SubprogramPrecompiler : public PluginRewriter{
+private:
+	NestedHexPlugin& plugin;
+public:
+	SubprogramPrecompiler(NestedHexPlugin& plugin) : plugin(plugin) {}
+	virtual ~SubprogramPrecompiler() {}
+
+	virtual void rewrite(ProgramCtx& ctx){
+		DBGLOG(DBG, "Precompiling subprograms");
+		plugin.precompileSubprograms(ctx, ctx.idb);
+	}
+};
+
+PluginRewriterPtr NestedHexPlugin::createRewriter(ProgramCtx& ctx){
+	return PluginRewriterPtr(new SubprogramPrecompiler(*this));
+}
+
 void NestedHexPlugin::setupProgramCtx(ProgramCtx& ctx){
 
 	DBGLOG(DBG,"NestedHexPlugin::setupProgramCtx(ProgramCtx& ctx)");
@@ -0,0 +1,405 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file PersistentCache.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Stores answers of subprograms on disk such that they can be reused by later runs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "PersistentCache.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Logger.h"
+#include "dlvhex2/PluginInterface.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <set>
+
+#include "boost/foreach.hpp"
+#include "boost/filesystem.hpp"
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+namespace{
+
+const std::string magic = "NESTEDHEXCACHE4";
+
+// numbers are written in little endian byte order, strings are prefixed by their length
+
+void writeNumber(std::ostream& o, boost::uint32_t n){
+
+	char bytes[4];
+	for (int i = 0; i < 4; ++i) bytes[i] = static_cast<char>((n >> (8 * i)) & 0xff);
+	o.write(bytes, 4);
+}
+
+bool readNumber(std::istream& i, boost::uint32_t& n){
+
+	unsigned char bytes[4];
+	if (!i.read(reinterpret_cast<char*>(bytes), 4)) return false;
+	n = 0;
+	for (int b = 0; b < 4; ++b) n |= static_cast<boost::uint32_t>(bytes[b]) << (8 * b);
+	return true;
+}
+
+void writeString(std::ostream& o, const std::string& s){
+
+	writeNumber(o, s.length());
+	o.write(s.data(), s.length());
+}
+
+bool readString(std::istream& i, std::string& s){
+
+	boost::uint32_t length;
+	if (!readNumber(i, length)) return false;
+	s.resize(length);
+	return length == 0 || !!i.read(&s[0], length);
+}
+
+// writes the atoms of an interpretation as indices into the atom table
+void writeAtoms(std::ostream& o, InterpretationConstPtr intr, const std::map<IDAddress, boost::uint32_t>& atomIndex){
+
+	std::vector<boost::uint32_t> indices;
+	bm::bvector<>::enumerator en = intr->getStorage().first();
+	bm::bvector<>::enumerator en_end = intr->getStorage().end();
+	while (en < en_end){
+		std::map<IDAddress, boost::uint32_t>::const_iterator it = atomIndex.find(*en);
+		if (it != atomIndex.end()) indices.push_back(it->second);
+		en++;
+	}
+	writeNumber(o, indices.size());
+	BOOST_FOREACH (boost::uint32_t index, indices) writeNumber(o, index);
+}
+
+bool readAtoms(std::istream& i, RegistryPtr reg, const std::vector<ID>& atoms, InterpretationPtr& intr){
+
+	boost::uint32_t count, index;
+	if (!readNumber(i, count)) return false;
+	intr = InterpretationPtr(new Interpretation(reg));
+	for (boost::uint32_t a = 0; a < count; ++a){
+		if (!readNumber(i, index) || index >= atoms.size()) return false;
+		intr->setFact(atoms[index].address);
+	}
+	return true;
+}
+
+}
+
+PersistentCache::PersistentCache(const std::string& directory) : directory(directory){
+
+	try{
+		boost::filesystem::create_directories(directory);
+	}catch(const boost::filesystem::filesystem_error& e){
+		throw PluginError("Could not create cache directory " + directory + ": " + e.what());
+	}
+}
+
+bool PersistentCache::encodeAtom(RegistryPtr reg, IDAddress adr, std::string& code){
+
+	std::ostringstream o(std::ios::out | std::ios::binary);
+	BOOST_FOREACH (ID term, reg->ogatoms.getByAddress(adr).tuple){
+		if (term.isIntegerTerm()){
+			o.put('i');
+			writeNumber(o, term.address);
+		}else if (term.isConstantTerm() && !term.isAuxiliary()){
+			o.put('c');
+			writeString(o, reg->terms.getByID(term).symbol);
+		}else{
+			return false;
+		}
+	}
+	code = o.str();
+	return true;
+}
+
+ID PersistentCache::decodeAtom(RegistryPtr reg, const std::string& code){
+
+	std::istringstream i(code, std::ios::in | std::ios::binary);
+	OrdinaryAtom oatom(ID::MAINKIND_ATOM | ID::SUBKIND_ATOM_ORDINARYG);
+	char tag;
+	while (i.get(tag)){
+		if (tag == 'i'){
+			boost::uint32_t value;
+			if (!readNumber(i, value)) return ID_FAIL;
+			oatom.tuple.push_back(ID::termFromInteger(value));
+		}else if (tag == 'c'){
+			std::string symbol;
+			if (!readString(i, symbol)) return ID_FAIL;
+			oatom.tuple.push_back(reg->storeConstantTerm(symbol));
+		}else{
+			return ID_FAIL;
+		}
+	}
+	if (oatom.tuple.size() == 0) return ID_FAIL;
+	return reg->storeOrdinaryAtom(oatom);
+}
+
+bool PersistentCache::encodeInput(RegistryPtr reg, InterpretationConstPtr input, std::vector<std::string>& codes){
+
+	bm::bvector<>::enumerator en = input->getStorage().first();
+	bm::bvector<>::enumerator en_end = input->getStorage().end();
+	while (en < en_end){
+		std::string code;
+		if (!encodeAtom(reg, *en, code)) return false;
+		codes.push_back(code);
+		en++;
+	}
+	std::sort(codes.begin(), codes.end());
+	return true;
+}
+
+bool PersistentCache::getSignature(const Subprogram& subprogram, std::string& signature){
+
+	// the called subprograms are appended in the order of a depth-first traversal, each of them once
+	std::set<const Subprogram*> visited;
+	std::vector<const Subprogram*> pending;
+	std::vector<SubprogramPtr> locked;	// keeps the called subprograms alive during the traversal
+	std::ostringstream o(std::ios::out | std::ios::binary);
+	pending.push_back(&subprogram);
+	while (pending.size() > 0){
+		const Subprogram* current = pending.back();
+		pending.pop_back();
+		if (!visited.insert(current).second) continue;
+		if (current->hasDynamicCalls) return false;
+		writeString(o, current->normalizedSource);
+		for (std::vector<boost::weak_ptr<Subprogram> >::const_reverse_iterator it = current->calledSubprograms.rbegin(); it != current->calledSubprograms.rend(); ++it){
+			// a called subprogram which has been released was changed in the meantime
+			SubprogramPtr called = it->lock();
+			if (!called) return false;
+			locked.push_back(called);
+			pending.push_back(called.get());
+		}
+	}
+	signature = o.str();
+	return true;
+}
+
+boost::uint64_t PersistentCache::hash(const std::string& data){
+
+	boost::uint64_t h = 14695981039346656037ULL;
+	for (std::size_t i = 0; i < data.length(); ++i){
+		h ^= static_cast<unsigned char>(data[i]);
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+std::string PersistentCache::getFilename(const std::string& signature, const std::vector<std::string>& input) const{
+
+	// the strings are prefixed by their lengths such that different splits of the same bytes do not collide
+	std::ostringstream o(std::ios::out | std::ios::binary);
+	writeString(o, signature);
+	writeNumber(o, input.size());
+	BOOST_FOREACH (const std::string& code, input) writeString(o, code);
+	boost::uint64_t key = hash(o.str());
+	std::ostringstream name;
+	name << std::hex << std::setw(16) << std::setfill('0') << key << ".nhc";
+	return (boost::filesystem::path(directory) / name.str()).string();
+}
+
+bool PersistentCache::load(RegistryPtr reg, HexAnswerPtr answer){
+
+	std::string signature;
+	std::vector<std::string> input;
+	if (!getSignature(*answer->subprogram, signature) || !encodeInput(reg, answer->input, input)) return false;
+	std::string filename = getFilename(signature, input);
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file.is_open()) return false;
+
+	// confirm the match
+	std::string s;
+	if (!readString(file, s) || s != magic) return false;
+	if (!readString(file, s) || s != signature) return false;
+	boost::uint32_t count;
+	if (!readNumber(file, count) || count != input.size()) return false;
+	for (boost::uint32_t i = 0; i < count; ++i){
+		if (!readString(file, s) || s != input[i]) return false;
+	}
+
+	// map the atoms into the registry of this run
+	std::vector<ID> atoms;
+	if (!readNumber(file, count)) return false;
+	for (boost::uint32_t i = 0; i < count; ++i){
+		if (!readString(file, s)) return false;
+		ID atom = decodeAtom(reg, s);
+		if (atom == ID_FAIL) return false;
+		atoms.push_back(atom);
+	}
+
+	// read into a separate answer first such that a corrupt file does not leave a partially filled one
+	HexAnswer stored;
+	char consistent, answersetsComputed;
+	if (!file.get(consistent) || !file.get(answersetsComputed)) return false;
+	if (!readNumber(file, count)) return false;
+	for (boost::uint32_t i = 0; i < count; ++i){
+		InterpretationPtr as;
+		if (!readAtoms(file, reg, atoms, as)) return false;
+		stored.answersets.push_back(as);
+	}
+	char summarized;
+	boost::uint32_t answersetCount = 0;
+	if (!file.get(summarized)) return false;
+	if (summarized){
+		if (!readNumber(file, answersetCount)) return false;
+		if (!readAtoms(file, reg, atoms, stored.answersetIntersection) || !readAtoms(file, reg, atoms, stored.answersetUnion)) return false;
+	}
+	for (int map = 0; map < 2; ++map){
+		if (!readNumber(file, count)) return false;
+		for (boost::uint32_t i = 0; i < count; ++i){
+			InterpretationPtr consequences;
+			if (!readString(file, s) || !readAtoms(file, reg, atoms, consequences)) return false;
+			(map == 0 ? stored.cautiousConsequences : stored.braveConsequences)[reg->storeConstantTerm(s)] = consequences;
+		}
+	}
+
+	DBGLOG(DBG, "Loaded answer from " << filename);
+	answer->consistent = (consistent == 2 ? boost::logic::tribool(boost::logic::indeterminate) : boost::logic::tribool(consistent == 1));
+	if (answersetsComputed){
+		answer->answersets = stored.answersets;
+		answer->answersetsComputed = true;
+		answer->answersetCount = answer->answersets.size();
+	}
+	if (summarized){
+		answer->answersetIntersection = stored.answersetIntersection;
+		answer->answersetUnion = stored.answersetUnion;
+		answer->answersetCount = answersetCount;
+	}
+	answer->cautiousConsequences = stored.cautiousConsequences;
+	answer->braveConsequences = stored.braveConsequences;
+	return true;
+}
+
+void PersistentCache::store(RegistryPtr reg, HexAnswerPtr answer){
+
+	std::string signature;
+	std::vector<std::string> input;
+	if (!getSignature(*answer->subprogram, signature) || !encodeInput(reg, answer->input, input)) return;
+
+	// collect the atoms of all stored interpretations in a table
+	std::vector<InterpretationConstPtr> interpretations;
+	if (answer->answersetsComputed) interpretations.insert(interpretations.end(), answer->answersets.begin(), answer->answersets.end());
+	if (!!answer->answersetIntersection){
+		interpretations.push_back(answer->answersetIntersection);
+		interpretations.push_back(answer->answersetUnion);
+	}
+	typedef std::pair<ID, InterpretationPtr> QueryResult;
+	BOOST_FOREACH (const QueryResult& qr, answer->cautiousConsequences) interpretations.push_back(qr.second);
+	BOOST_FOREACH (const QueryResult& qr, answer->braveConsequences) interpretations.push_back(qr.second);
+	std::map<IDAddress, boost::uint32_t> atomIndex;
+	std::vector<std::string> atoms;
+	BOOST_FOREACH (InterpretationConstPtr intr, interpretations){
+		bm::bvector<>::enumerator en = intr->getStorage().first();
+		bm::bvector<>::enumerator en_end = intr->getStorage().end();
+		while (en < en_end){
+			std::string code;
+			if (atomIndex.count(*en) == 0 && !reg->ogatoms.getIDByAddress(*en).isAuxiliary()){
+				// an answer without some of its atoms would be wrong when it is loaded
+				if (!encodeAtom(reg, *en, code)){
+					DBGLOG(DBG, "Answer contains atoms which cannot be stored, it is not persisted");
+					return;
+				}
+				atomIndex[*en] = atoms.size();
+				atoms.push_back(code);
+			}
+			en++;
+		}
+	}
+
+	std::ostringstream o(std::ios::out | std::ios::binary);
+	writeString(o, magic);
+	writeString(o, signature);
+	writeNumber(o, input.size());
+	BOOST_FOREACH (const std::string& code, input) writeString(o, code);
+	writeNumber(o, atoms.size());
+	BOOST_FOREACH (const std::string& code, atoms) writeString(o, code);
+	o.put(boost::logic::indeterminate(answer->consistent) ? 2 : (answer->consistent ? 1 : 0));
+	o.put(answer->answersetsComputed ? 1 : 0);
+	writeNumber(o, answer->answersetsComputed ? answer->answersets.size() : 0);
+	if (answer->answersetsComputed){
+		BOOST_FOREACH (InterpretationConstPtr as, answer->answersets) writeAtoms(o, as, atomIndex);
+	}
+	o.put(!!answer->answersetIntersection ? 1 : 0);
+	if (!!answer->answersetIntersection){
+		writeNumber(o, answer->answersetCount);
+		writeAtoms(o, answer->answersetIntersection, atomIndex);
+		writeAtoms(o, answer->answersetUnion, atomIndex);
+	}
+	for (int map = 0; map < 2; ++map){
+		const std::map<ID, InterpretationPtr>& results = (map == 0 ? answer->cautiousConsequences : answer->braveConsequences);
+		writeNumber(o, results.size());
+		BOOST_FOREACH (const QueryResult& qr, results){
+			writeString(o, reg->terms.getByID(qr.first).symbol);
+			writeAtoms(o, qr.second, atomIndex);
+		}
+	}
+
+	// write to a temporary file first such that concurrent runs never read a partially written one;
+	// the name of the temporary file is unique such that concurrent runs which store the same answer do not write into the same file
+	std::string filename = getFilename(signature, input);
+	std::string tmpFilename;
+	try{
+		tmpFilename = boost::filesystem::unique_path(filename + ".%%%%-%%%%-%%%%-%%%%.tmp").string();
+	}catch(const boost::filesystem::filesystem_error& e){
+		LOG(WARNING, "Could not write cache file " << filename << ": " << e.what());
+		return;
+	}
+	{
+		std::ofstream file(tmpFilename.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		std::string data = o.str();
+		if (!file.is_open() || !file.write(data.data(), data.length())){
+			LOG(WARNING, "Could not write cache file " << tmpFilename);
+			boost::system::error_code ec;
+			boost::filesystem::remove(tmpFilename, ec);
+			return;
+		}
+	}
+	try{
+		boost::filesystem::rename(tmpFilename, filename);
+		DBGLOG(DBG, "Stored answer in " << filename);
+	}catch(const boost::filesystem::filesystem_error& e){
+		LOG(WARNING, "Could not write cache file " << filename << ": " << e.what());
+		boost::system::error_code ec;
+		boost::filesystem::remove(tmpFilename, ec);
+	}
+}
+
+}
+
+DLVHEX_NAMESPACE_END
+
+/* vim: set noet sw=2 ts=2 tw=80: */
+
+// Local Variables:
+// mode: C++
+// End:
@@ -0,0 +1,125 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file Statistics.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Reports statistics about the evaluation of subprograms.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "Statistics.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Logger.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+
+#include "boost/foreach.hpp"
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+namespace{
+
+// escapes backslashes, tabs and line breaks such that a field cannot break the columns or rows of the table
+std::string escapeField(const std::string& field){
+
+	std::string escaped;
+	BOOST_FOREACH (char c, field){
+		switch (c){
+			case '\\': escaped += "\\\\"; break;
+			case '\t': escaped += "\\t"; break;
+			case '\n': escaped += "\\n"; break;
+			case '\r': escaped += "\\r"; break;
+			default: escaped += c;
+		}
+	}
+	return escaped;
+}
+
+}
+
+Statistics::Statistics(const std::string& filename) : filename(filename), cache(0), reported(false){
+}
+
+void Statistics::addSubprogram(SubprogramPtr subprogram){
+
+	boost::mutex::scoped_lock lock(mutex);
+	subprograms.push_back(subprogram);
+}
+
+void Statistics::setCache(const AnswerCache* cache){
+
+	boost::mutex::scoped_lock lock(mutex);
+	this->cache = cache;
+}
+
+void Statistics::report(){
+
+	boost::mutex::scoped_lock lock(mutex);
+	if (reported) return;
+	reported = true;
+
+	if (filename.empty()){
+		std::cerr << "Nested HEX statistics:" << std::endl;
+		BOOST_FOREACH (SubprogramPtr subprogram, subprograms){
+			const SubprogramStatistics& stats = subprogram->statistics;
+			std::cerr << "  " << subprogram->name << std::endl <<
+				"    calls: " << stats.calls << " (cache hits: " << stats.hits << ", misses: " << stats.misses << ")" << std::endl <<
+				"    solver calls: " << stats.evaluations << ", answer sets: " << stats.models << std::endl <<
+				"    time (s): parsing " << std::fixed << std::setprecision(3) << stats.parseTime << ", input translation " << stats.translationTime << ", evaluation " << stats.evaluationTime << std::endl;
+			if (!!cache) std::cerr << "    cached: " << cache->getEntryCount(subprogram.get()) << " answers, " << cache->getMemoryUsage(subprogram.get()) << " bytes" << std::endl;
+		}
+	}else{
+		std::ofstream file(filename.c_str());
+		if (!file.is_open()){
+			LOG(WARNING, "Could not write statistics to " << filename);
+			return;
+		}
+		file << "subprogram\tcalls\thits\tmisses\tsolvercalls\tanswersets\tparsetime\ttranslationtime\tevaluationtime\tcachedanswers\tcachedbytes" << std::endl;
+		BOOST_FOREACH (SubprogramPtr subprogram, subprograms){
+			const SubprogramStatistics& stats = subprogram->statistics;
+			file << escapeField(subprogram->name) << "\t" << stats.calls << "\t" << stats.hits << "\t" << stats.misses << "\t" << stats.evaluations << "\t" << stats.models << "\t" <<
+				stats.parseTime << "\t" << stats.translationTime << "\t" << stats.evaluationTime << "\t" <<
+				(!!cache ? cache->getEntryCount(subprogram.get()) : 0) << "\t" << (!!cache ? cache->getMemoryUsage(subprogram.get()) : 0) << std::endl;
+		}
+	}
+}
+
+}
+
+DLVHEX_NAMESPACE_END
+
+/* vim: set noet sw=2 ts=2 tw=80: */
+
+// Local Variables:
+// mode: C++
+// End:
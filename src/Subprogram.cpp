@@ -0,0 +1,284 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file Subprogram.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Parsed representation of nested HEX-programs.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "Subprogram.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Logger.h"
+#include "dlvhex2/PluginInterface.h"
+#include "dlvhex2/Registry.h"
+
+#include <fstream>
+#include <sstream>
+
+#include "boost/filesystem.hpp"
+#include "boost/foreach.hpp"
+#include <boost/functional/hash.hpp>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+namespace{
+
+inline bool isIdentifierChar(char c){
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// checks if target is reachable from source in the predicate dependency graph
+bool isReachable(const std::map<ID, std::set<ID> >& dependencies, ID source, ID target){
+
+	std::set<ID> visited;
+	std::vector<ID> open(1, source);
+	while (!open.empty()){
+		ID pred = open.back();
+		open.pop_back();
+		if (pred == target) return true;
+		if (!visited.insert(pred).second) continue;
+		std::map<ID, std::set<ID> >::const_iterator it = dependencies.find(pred);
+		if (it != dependencies.end()) open.insert(open.end(), it->second.begin(), it->second.end());
+	}
+	return false;
+}
+
+}
+
+// ============================== Class Subprogram ==============================
+
+std::string Subprogram::normalize(const std::string& source){
+
+	std::string normalized;
+	normalized.reserve(source.length());
+	bool pendingSpace = false;
+	for (std::size_t i = 0; i < source.length(); ++i){
+		char c = source[i];
+		if (c == '"'){
+			// copy quoted strings verbatim
+			if (pendingSpace && !normalized.empty() && isIdentifierChar(normalized[normalized.length() - 1])) normalized.push_back(' ');
+			pendingSpace = false;
+			normalized.push_back(c);
+			for (++i; i < source.length(); ++i){
+				normalized.push_back(source[i]);
+				if (source[i] == '\\' && i + 1 < source.length()) normalized.push_back(source[++i]);
+				else if (source[i] == '"') break;
+			}
+		}else if (c == '%'){
+			// skip comments
+			while (i < source.length() && source[i] != '\n') ++i;
+			pendingSpace = true;
+		}else if (c == ' ' || c == '\t' || c == '\n' || c == '\r'){
+			pendingSpace = true;
+		}else{
+			// whitespace is only significant between two identifiers, e.g. in "not a"
+			if (pendingSpace && !normalized.empty() && isIdentifierChar(normalized[normalized.length() - 1]) && isIdentifierChar(c)) normalized.push_back(' ');
+			pendingSpace = false;
+			normalized.push_back(c);
+		}
+	}
+	return normalized;
+}
+
+void Subprogram::analyze(RegistryPtr reg){
+
+	hasWeakConstraints = false;
+	monotone = true;
+	hasConstraints = false;
+	bodyPredicates.clear();
+	readPredicates.clear();
+	readPredicatesKnown = true;
+	ordinary = true;
+	BOOST_FOREACH (ID ruleID, idb){
+		if (ruleID.isWeakConstraint()){
+			hasWeakConstraints = true;
+			ordinary = false;
+		}
+
+		const Rule& rule = reg->rules.getByID(ruleID);
+		if (ruleID.isWeakConstraint() || rule.head.size() > 1) monotone = false;
+		if (rule.head.size() == 0) hasConstraints = true;
+		// a fact over a head atom of a disjunctive rule suppresses the other head atoms
+		if (rule.head.size() > 1){
+			BOOST_FOREACH (ID h, rule.head) readPredicates.insert(reg->lookupOrdinaryAtom(h).tuple[0]);
+		}
+		BOOST_FOREACH (ID lit, rule.body){
+			if (lit.isNaf() || lit.isExternalAtom() || lit.isAggregateAtom()) monotone = false;
+			if (!lit.isOrdinaryAtom() && !lit.isBuiltinAtom()) ordinary = false;
+			if (lit.isOrdinaryAtom()){
+				bodyPredicates.insert(reg->lookupOrdinaryAtom(lit).tuple[0]);
+			}else if (lit.isExternalAtom()){
+				// input predicates are constants (this might include some other constant inputs, which does no harm)
+				BOOST_FOREACH (ID input, reg->eatoms.getByID(lit).inputs){
+					if (input.isConstantTerm()) readPredicates.insert(input);
+				}
+			}else if (!lit.isBuiltinAtom()){
+				readPredicatesKnown = false;
+			}
+		}
+	}
+	readPredicates.insert(bodyPredicates.begin(), bodyPredicates.end());
+}
+
+SubprogramPtr Subprogram::slice(RegistryPtr reg, ID queryPredicate) const{
+
+	// with weak constraints, the optimal answer sets depend on all rules
+	if (hasWeakConstraints) return SubprogramPtr();
+
+	// the predicates of the slice form a splitting set: it contains the query predicate and all predicates in constraints,
+	// and for each rule with a head predicate in the slice, all predicates of the rule
+	std::set<ID> predicates;
+	predicates.insert(queryPredicate);
+	std::vector<bool> inSlice(idb.size(), false);
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (std::size_t i = 0; i < idb.size(); ++i){
+			if (inSlice[i]) continue;
+			const Rule& rule = reg->rules.getByID(idb[i]);
+			bool relevant = (rule.head.size() == 0);
+			BOOST_FOREACH (ID h, rule.head){
+				if (predicates.count(reg->lookupOrdinaryAtom(h).tuple[0]) > 0) relevant = true;
+			}
+			if (!relevant) continue;
+
+			inSlice[i] = true;
+			changed = true;
+			BOOST_FOREACH (ID h, rule.head) predicates.insert(reg->lookupOrdinaryAtom(h).tuple[0]);
+			BOOST_FOREACH (ID lit, rule.body){
+				if (lit.isOrdinaryAtom()){
+					predicates.insert(reg->lookupOrdinaryAtom(lit).tuple[0]);
+				}else if (lit.isExternalAtom()){
+					// input predicates are constants (this might include some other constant inputs, which does no harm)
+					BOOST_FOREACH (ID input, reg->eatoms.getByID(lit).inputs){
+						if (input.isConstantTerm()) predicates.insert(input);
+					}
+				}else if (!lit.isBuiltinAtom()){
+					// the dependencies of aggregates and other atoms are not analyzed
+					return SubprogramPtr();
+				}
+			}
+		}
+	}
+
+	// the remaining rules must have an answer set for every answer set of the slice, which is the case if they are
+	// positive or stratified, i.e., no predicate depends negatively on itself (then slicing does not change the answer sets over the slice)
+	std::vector<ID> sliceRules;
+	std::map<ID, std::set<ID> > dependencies;
+	std::vector<std::pair<ID, ID> > negativeDependencies;
+	for (std::size_t i = 0; i < idb.size(); ++i){
+		if (inSlice[i]){
+			sliceRules.push_back(idb[i]);
+			continue;
+		}
+		const Rule& rule = reg->rules.getByID(idb[i]);
+		BOOST_FOREACH (ID lit, rule.body){
+			if (lit.isBuiltinAtom()) continue;
+			if (!lit.isOrdinaryAtom()) return SubprogramPtr();
+			ID bodyPredicate = reg->lookupOrdinaryAtom(lit).tuple[0];
+			BOOST_FOREACH (ID h, rule.head){
+				ID headPredicate = reg->lookupOrdinaryAtom(h).tuple[0];
+				dependencies[headPredicate].insert(bodyPredicate);
+				if (lit.isNaf()) negativeDependencies.push_back(std::pair<ID, ID>(headPredicate, bodyPredicate));
+			}
+		}
+	}
+	if (sliceRules.size() == idb.size()) return SubprogramPtr();
+	typedef std::pair<ID, ID> Dependency;
+	BOOST_FOREACH (const Dependency& dep, negativeDependencies){
+		if (isReachable(dependencies, dep.second, dep.first)) return SubprogramPtr();
+	}
+
+	DBGLOG(DBG, "Slice of subprogram " << name << " for the query predicate has " << sliceRules.size() << " of " << idb.size() << " rules");
+	SubprogramPtr slice(new Subprogram());
+	slice->name = name + " (slice for " + reg->terms.getByID(queryPredicate).symbol + ")";
+	slice->normalizedSource = normalizedSource + "\n% slice for " + reg->terms.getByID(queryPredicate).symbol;
+	slice->hash = hash;
+	boost::hash_combine(slice->hash, queryPredicate.address);
+	slice->idb = sliceRules;
+	slice->edb = InterpretationPtr(new Interpretation(reg));
+	bm::bvector<>::enumerator en = edb->getStorage().first();
+	bm::bvector<>::enumerator en_end = edb->getStorage().end();
+	while (en < en_end){
+		if (predicates.count(reg->ogatoms.getByAddress(*en).tuple[0]) > 0) slice->edb->setFact(*en);
+		en++;
+	}
+	slice->analyze(reg);
+	slice->calledSubprograms = calledSubprograms;
+	slice->hasDynamicCalls = hasDynamicCalls;
+	slice->pc = pc;
+	slice->pc.idb = sliceRules;
+	return slice;
+}
+
+// ============================== Class SubprogramReference ==============================
+
+std::string SubprogramReference::readFile(const std::string& filename, std::time_t& modificationTime, boost::uintmax_t& fileSize){
+
+	try{
+		modificationTime = boost::filesystem::last_write_time(filename);
+		fileSize = boost::filesystem::file_size(filename);
+	}catch(const boost::filesystem::filesystem_error& e){
+		throw PluginError("Cannot access subprogram file \"" + filename + "\": " + e.what());
+	}
+
+	std::ifstream file(filename.c_str(), std::ios::in | std::ios::binary);
+	if (!file.is_open()) throw PluginError("Cannot open subprogram file \"" + filename + "\"");
+	std::stringstream ss;
+	ss << file.rdbuf();
+	return ss.str();
+}
+
+bool SubprogramReference::isStale(){
+
+	if (filename.empty()) return false;
+	std::time_t now = std::time(0);
+	if (now - lastCheck < checkInterval) return false;
+	lastCheck = now;
+
+	boost::system::error_code ec;
+	std::time_t currentModificationTime = boost::filesystem::last_write_time(filename, ec);
+	if (ec) return true;
+	boost::uintmax_t currentFileSize = boost::filesystem::file_size(filename, ec);
+	if (ec) return true;
+	return currentModificationTime != modificationTime || currentFileSize != fileSize;
+}
+
+}
+
+DLVHEX_NAMESPACE_END
+
+/* vim: set noet sw=2 ts=2 tw=80: */
+
+// Local Variables:
+// mode: C++
+// End:
@@ -0,0 +1,334 @@
+/* dlvhex -- Answer-Set Programming with external interfaces.
+ * Copyright (C) 2005, 2006, 2007 Roman Schindlauer
+ * Copyright (C) 2006, 2007, 2008, 2009, 2010, 2011 Thomas Krennwallner
+ * Copyright (C) 2009, 2010, 2011 Peter Schüller
+ * Copyright (C) 2011, 2012, 2013, 2014 Christoph Redl
+ * 
+ * This file is part of dlvhex.
+ *
+ * dlvhex is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * dlvhex is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with dlvhex; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA.
+ */
+
+/**
+ * @file SupportSets.cpp
+ * @author Christoph Redl <redl@kr.tuwien.ac.at
+ *
+ * @brief Computes nonground support set templates of subprograms.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif // HAVE_CONFIG_H
+
+#include "SupportSets.h"
+#include "dlvhex2/PlatformDefinitions.h"
+#include "dlvhex2/Logger.h"
+#include "dlvhex2/Printer.h"
+
+#include <deque>
+#include <map>
+
+#include "boost/foreach.hpp"
+#include "boost/date_time/posix_time/posix_time.hpp"
+#include <boost/lexical_cast.hpp>
+
+DLVHEX_NAMESPACE_BEGIN
+
+namespace nestedhex{
+
+namespace{
+	// an atom up to variable renaming: the variables are numbered by their first occurrence
+	typedef std::vector<ID> Variant;
+
+	// the goals which were resolved in order to obtain a goal (innermost first)
+	struct AncestorChain;
+	typedef boost::shared_ptr<const AncestorChain> AncestorChainPtr;
+	struct AncestorChain{
+		Variant goal;
+		AncestorChainPtr parent;
+	};
+
+	struct Goal{
+		ID literal;
+		AncestorChainPtr ancestors;
+
+		Goal(ID literal, AncestorChainPtr ancestors = AncestorChainPtr()) : literal(literal), ancestors(ancestors) {}
+	};
+
+	// partial unfolding: the head, the literals which still need to be resolved and the ones which are kept,
+	// and the number of rules which were applied (which selects the variables for renaming the next one apart)
+	struct Unfolding{
+		ID head;
+		std::vector<Goal> goals;
+		std::vector<ID> body;
+		std::size_t depth;
+
+		Unfolding() : depth(0) {}
+	};
+
+	Variant getVariant(const OrdinaryAtom& atom){
+		Variant variant;
+		std::map<ID, IDAddress> numbering;
+		BOOST_FOREACH (ID term, atom.tuple){
+			if (term.isVariableTerm()){
+				std::map<ID, IDAddress>::iterator it = numbering.insert(std::pair<ID, IDAddress>(term, numbering.size())).first;
+				variant.push_back(ID(ID::MAINKIND_TERM | ID::SUBKIND_TERM_VARIABLE, it->second));
+			}else{
+				variant.push_back(term);
+			}
+		}
+		return variant;
+	}
+
+	bool isRepeated(const Variant& variant, AncestorChainPtr ancestors){
+		for (; !!ancestors; ancestors = ancestors->parent){
+			if (ancestors->goal == variant) return true;
+		}
+		return false;
+	}
+}
+
+// ============================== Class SupportSetTemplate ==============================
+
+bool SupportSetTemplate::operator<(const SupportSetTemplate& other) const{
+
+	if (head != other.head) return head < other.head;
+	return body < other.body;
+}
+
+// ============================== Class SupportSetGenerator ==============================
+
+SupportSetGenerator::SupportSetGenerator(RegistryPtr reg, const Subprogram& subprogram, std::size_t maxSize, double maxTime) : reg(reg), subprogram(subprogram), maxSize(maxSize), maxTime(maxTime){
+
+	BOOST_FOREACH (ID ruleID, subprogram.idb){
+		const Rule& rule = reg->rules.getByID(ruleID);
+		if (rule.head.size() == 1 && !ruleID.isWeakConstraint()) rulesByHeadPredicate.insert(RuleIndex::value_type(reg->lookupOrdinaryAtom(rule.head[0]).tuple[0], ruleID));
+	}
+	bm::bvector<>::enumerator en = subprogram.edb->getStorage().first();
+	bm::bvector<>::enumerator en_end = subprogram.edb->getStorage().end();
+	while (en < en_end){
+		factsByPredicate.insert(FactIndex::value_type(reg->ogatoms.getByAddress(*en).tuple[0], reg->ogatoms.getIDByAddress(*en)));
+		en++;
+	}
+}
+
+ID SupportSetGenerator::resolve(const Substitution& subst, ID term) const{
+
+	Substitution::const_iterator it;
+	while (term.isVariableTerm() && (it = subst.find(term)) != subst.end()) term = it->second;
+	return term;
+}
+
+bool SupportSetGenerator::unify(const OrdinaryAtom& a1, const OrdinaryAtom& a2, Substitution& subst) const{
+
+	if (a1.tuple.size() != a2.tuple.size()) return false;
+	for (std::size_t i = 0; i < a1.tuple.size(); ++i){
+		ID t1 = resolve(subst, a1.tuple[i]);
+		ID t2 = resolve(subst, a2.tuple[i]);
+		if (t1 == t2) continue;
+		if (t1.isVariableTerm()) subst[t1] = t2;
+		else if (t2.isVariableTerm()) subst[t2] = t1;
+		else return false;
+	}
+	return true;
+}
+
+ID SupportSetGenerator::substitute(const Substitution& subst, ID atomOrLiteral){
+
+	// other literals are not substituted, they are rejected when they are unfolded
+	if (!atomOrLiteral.isOrdinaryAtom()) return atomOrLiteral;
+
+	OrdinaryAtom atom = reg->lookupOrdinaryAtom(atomOrLiteral);
+	bool ground = true;
+	BOOST_FOREACH (ID& term, atom.tuple){
+		term = resolve(subst, term);
+		if (term.isVariableTerm()) ground = false;
+	}
+	atom.kind = ID::MAINKIND_ATOM | (ground ? ID::SUBKIND_ATOM_ORDINARYG : ID::SUBKIND_ATOM_ORDINARYN);
+	ID atomID = reg->storeOrdinaryAtom(atom);
+	return atomOrLiteral.isLiteral() ? ID::literalFromAtom(atomID, atomOrLiteral.isNaf()) : atomID;
+}
+
+void SupportSetGenerator::renameApart(const Rule& rule, std::size_t depth, Substitution& renaming){
+
+	// the variables of the rule which is applied at some depth of an unfolding only need to be distinct from the ones applied before,
+	// thus the same variables are used at the same depth of all unfoldings (such that the registry does not grow with the number of steps)
+	std::string suffix = "_S" + boost::lexical_cast<std::string>(depth);
+	std::vector<ID> atoms = rule.head;
+	atoms.insert(atoms.end(), rule.body.begin(), rule.body.end());
+	BOOST_FOREACH (ID atom, atoms){
+		if (!atom.isOrdinaryAtom()) continue;
+		BOOST_FOREACH (ID term, reg->lookupOrdinaryAtom(atom).tuple){
+			if (term.isVariableTerm() && renaming.count(term) == 0) renaming[term] = reg->storeVariableTerm(reg->terms.getByID(term).symbol + suffix);
+		}
+	}
+}
+
+std::set<ID> SupportSetGenerator::getDependencies(ID predicate) const{
+
+	std::set<ID> dependencies;
+	std::vector<ID> open(1, predicate);
+	while (!open.empty()){
+		ID current = open.back();
+		open.pop_back();
+		std::pair<RuleIndex::const_iterator, RuleIndex::const_iterator> rules = rulesByHeadPredicate.equal_range(current);
+		for (RuleIndex::const_iterator it = rules.first; it != rules.second; ++it){
+			BOOST_FOREACH (ID lit, reg->rules.getByID(it->second).body){
+				if (!lit.isOrdinaryAtom()) continue;
+				ID bodyPredicate = reg->lookupOrdinaryAtom(lit).tuple[0];
+				if (dependencies.insert(bodyPredicate).second) open.push_back(bodyPredicate);
+			}
+		}
+	}
+	return dependencies;
+}
+
+SupportSetTemplatesPtr SupportSetGenerator::generate(ID queryPredicate, const std::set<ID>& inputPredicates){
+
+	DBGLOG(DBG, "Computing support set templates for query predicate " << RawPrinter::toString(reg, queryPredicate));
+	SupportSetTemplatesPtr result(new SupportSetTemplates());
+
+	std::set<ID> dependencies = getDependencies(queryPredicate);
+	dependencies.insert(queryPredicate);
+	BOOST_FOREACH (ID predicate, dependencies){
+		if (getDependencies(predicate).count(predicate) > 0) result->recursive = true;
+	}
+	boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+
+	// facts over the query predicate are derived from every input
+	std::set<SupportSetTemplate> templates;
+	std::pair<FactIndex::iterator, FactIndex::iterator> queryFacts = factsByPredicate.equal_range(queryPredicate);
+	for (FactIndex::iterator it = queryFacts.first; it != queryFacts.second; ++it){
+		SupportSetTemplate t;
+		t.head = it->second;
+		templates.insert(t);
+	}
+
+	std::deque<Unfolding> open;
+	std::pair<RuleIndex::iterator, RuleIndex::iterator> rules = rulesByHeadPredicate.equal_range(queryPredicate);
+	for (RuleIndex::iterator it = rules.first; it != rules.second; ++it){
+		const Rule& rule = reg->rules.getByID(it->second);
+		Unfolding u;
+		u.head = rule.head[0];
+		BOOST_FOREACH (ID lit, rule.body) u.goals.push_back(Goal(lit));
+		open.push_back(u);
+	}
+
+	while (!open.empty()){
+		if ((boost::posix_time::microsec_clock::universal_time() - start).total_microseconds() / 1000000.0 > maxTime){
+			DBGLOG(DBG, "Time limit for support set templates reached");
+			result->complete = false;
+			break;
+		}
+		Unfolding u = open.front();
+		open.pop_front();
+
+		if (u.goals.size() + u.body.size() > maxSize){
+			result->complete = false;
+			continue;
+		}
+		if (u.goals.empty()){
+			SupportSetTemplate t;
+			t.head = u.head;
+			t.body = u.body;
+			std::sort(t.body.begin(), t.body.end());
+			templates.insert(t);
+			continue;
+		}
+
+		Goal current = u.goals.back();
+		ID goal = current.literal;
+		u.goals.pop_back();
+		if (!goal.isOrdinaryAtom()){
+			// builtin atoms, aggregates and external atoms cannot be expressed over the input
+			result->complete = false;
+			continue;
+		}
+		ID predicate = reg->lookupOrdinaryAtom(goal).tuple[0];
+
+		// literals over input predicates are kept
+		if (inputPredicates.count(predicate) > 0){
+			Unfolding kept = u;
+			kept.body.push_back(goal);
+			open.push_back(kept);
+		}
+		if (goal.isNaf()){
+			if (inputPredicates.count(predicate) == 0) result->complete = false;
+			continue;
+		}
+
+		// resolve positive atoms with the facts of the subprogram
+		// (the atom is copied since substitution extends the atom tables)
+		OrdinaryAtom goalAtom = reg->lookupOrdinaryAtom(goal);
+		std::pair<FactIndex::iterator, FactIndex::iterator> facts = factsByPredicate.equal_range(predicate);
+		for (FactIndex::iterator it = facts.first; it != facts.second; ++it){
+			Substitution subst;
+			if (!unify(goalAtom, reg->ogatoms.getByID(it->second), subst)) continue;
+			Unfolding resolved;
+			resolved.head = substitute(subst, u.head);
+			resolved.depth = u.depth;
+			BOOST_FOREACH (const Goal& g, u.goals) resolved.goals.push_back(Goal(substitute(subst, g.literal), g.ancestors));
+			BOOST_FOREACH (ID lit, u.body) resolved.body.push_back(substitute(subst, lit));
+			open.push_back(resolved);
+		}
+
+		// and with the rules deriving them, unless the goal repeats one it was derived from or too many rules have been applied
+		// (this ensures termination for recursive rules, but the longer derivations are not explored then)
+		rules = rulesByHeadPredicate.equal_range(predicate);
+		if (rules.first == rules.second) continue;
+		Variant variant = getVariant(goalAtom);
+		if (isRepeated(variant, current.ancestors) || u.depth >= maxDepth){
+			result->complete = false;
+			continue;
+		}
+		boost::shared_ptr<AncestorChain> ancestors(new AncestorChain());
+		ancestors->goal = variant;
+		ancestors->parent = current.ancestors;
+		for (RuleIndex::iterator it = rules.first; it != rules.second; ++it){
+			const Rule& rule = reg->rules.getByID(it->second);
+			Substitution subst;
+			renameApart(rule, u.depth, subst);
+			ID head = substitute(subst, rule.head[0]);
+			std::vector<ID> ruleBody;
+			BOOST_FOREACH (ID lit, rule.body) ruleBody.push_back(substitute(subst, lit));
+
+			subst.clear();
+			OrdinaryAtom headAtom = reg->lookupOrdinaryAtom(head);
+			if (!unify(goalAtom, headAtom, subst)) continue;
+			Unfolding resolved;
+			resolved.head = substitute(subst, u.head);
+			resolved.depth = u.depth + 1;
+			BOOST_FOREACH (const Goal& g, u.goals) resolved.goals.push_back(Goal(substitute(subst, g.literal), g.ancestors));
+			BOOST_FOREACH (ID lit, ruleBody) resolved.goals.push_back(Goal(substitute(subst, lit), ancestors));
+			BOOST_FOREACH (ID lit, u.body) resolved.body.push_back(substitute(subst, lit));
+			open.push_back(resolved);
+		}
+	}
+
+	result->templates.assign(templates.begin(), templates.end());
+	DBGLOG(DBG, "Found " << result->templates.size() << " support set templates (" << (result->complete ? "complete" : "incomplete") << ")");
+	return result;
+}
+
+}
+
+DLVHEX_NAMESPACE_END
+
+/* vim: set noet sw=2 ts=2 tw=80: */
+
+// Local Variables:
+// mode: C++
+// End: